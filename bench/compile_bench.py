@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+"""Compile-time scaling benchmark.
+
+For every axis of gen_sysy.py, compiles generated programs of growing size and records
+wall time (fastest of --repeat runs) and peak RSS of the compiler. The slope of log(time)
+against log(size) is printed per axis: about 1 is linear, clearly above 1 means
+super-linear behavior.
+
+Usage: compile_bench.py --compiler build/compiler [--out DIR] [--axes funcs,expr]
+                        [--sizes 100,200,400] [--mode -riscv] [--repeat 3]
+"""
+
+import argparse
+import csv
+import math
+import os
+import re
+import subprocess
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import gen_sysy  # noqa: E402
+
+DEFAULT_SIZES = {
+    "funcs": [50, 100, 200, 400, 800],
+    "length": [250, 500, 1000, 2000, 4000],
+    "depth": [25, 50, 100, 200, 400],
+    "expr": [250, 500, 1000, 2000, 4000],
+    "garray": [1000, 4000, 16000, 64000, 256000],
+    "larray": [250, 500, 1000, 2000, 4000],
+}
+
+
+def run_once(compiler, mode, src, out):
+    """Run the compiler once, returns (seconds, exit status)."""
+    start = time.perf_counter()
+    status = subprocess.call([compiler, mode, src, "-o", out],
+                             stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    return time.perf_counter() - start, status
+
+
+def peak_rss(compiler, mode, src, out):
+    """Peak RSS in KiB, as reported by the compiler's own -mem-report.
+
+    The rusage of a forked child also counts the RSS of this Python process from before
+    `exec`, so it is only used when the compiler has no -mem-report.
+    """
+    proc = subprocess.Popen([compiler, mode, src, "-o", out, "-mem-report"],
+                            stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    err = proc.communicate()[1].decode(errors="replace")
+    m = re.search(r"Peak RSS: ([0-9.]+) KiB", err)
+    if proc.returncode == 0 and m:
+        return int(float(m.group(1)))
+    proc = subprocess.Popen([compiler, mode, src, "-o", out],
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    return os.wait4(proc.pid, 0)[2].ru_maxrss
+
+
+def slope(points):
+    """Least-squares slope of log(time) over log(size)."""
+    xs = [math.log(n) for n, t in points if t > 0]
+    ys = [math.log(t) for n, t in points if t > 0]
+    if len(xs) < 2:
+        return float("nan")
+    mx, my = sum(xs) / len(xs), sum(ys) / len(ys)
+    den = sum((x - mx) ** 2 for x in xs)
+    return sum((x - mx) * (y - my) for x, y in zip(xs, ys)) / den if den else float("nan")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compile-time scaling benchmark.")
+    parser.add_argument("--compiler", required=True)
+    parser.add_argument("--out", default="bench_out")
+    parser.add_argument("--axes", default=",".join(gen_sysy.AXES))
+    parser.add_argument("--sizes", help="comma separated sizes used for every axis")
+    parser.add_argument("--mode", default="-riscv", help="compiler mode (-koopa, -riscv, -perf)")
+    parser.add_argument("--repeat", type=int, default=3, help="runs per point, the fastest is kept")
+    args = parser.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    rows = []
+    failed = False
+    for axis in args.axes.split(","):
+        sizes = [int(s) for s in args.sizes.split(",")] if args.sizes else DEFAULT_SIZES[axis]
+        points = []
+        print("%-8s %10s %12s %12s" % ("axis", "size", "time (ms)", "RSS (KiB)"))
+        for n in sizes:
+            src = os.path.join(args.out, "%s_%d.c" % (axis, n))
+            with open(src, "w") as f:
+                f.write(gen_sysy.generate(axis, n))
+            best, status = None, 0
+            for _ in range(args.repeat):
+                t, status = run_once(args.compiler, args.mode, src, src + ".out")
+                best = t if best is None else min(best, t)
+                if status != 0:
+                    break
+            if status != 0:
+                failed = True
+                print("%-8s %10d   FAILED (exit status %d)" % (axis, n, status))
+                continue
+            rss = peak_rss(args.compiler, args.mode, src, src + ".out")
+            points.append((n, best))
+            rows.append({"axis": axis, "size": n, "time_ms": "%.3f" % (best * 1000), "peak_rss_kib": rss})
+            print("%-8s %10d %12.3f %12d" % (axis, n, best * 1000, rss))
+        print("%-8s growth exponent: %.2f\n" % (axis, slope(points)))
+
+    with open(os.path.join(args.out, "compile_bench.csv"), "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=["axis", "size", "time_ms", "peak_rss_kib"])
+        writer.writeheader()
+        writer.writerows(rows)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""Synthetic SysY program generator for the compile-time scaling benchmark.
+
+Each axis stresses one part of the compiler which is sensitive to input size:
+
+    funcs   number of functions                 (whole pipeline, per-function backend)
+    length  statements in one function          (Block, stack frame layout)
+    depth   nesting depth of blocks             (SymbolTab scope stack lookups)
+    expr    depth of one expression tree        (recursive build_koopa_values)
+    garray  size of an initialized global array (InitValAST, Visit_aggregate)
+    larray  size of an initialized local array  (InitValAST, ArrayDefAST stores)
+
+Usage: gen_sysy.py AXIS N [-o FILE]
+"""
+
+import argparse
+import sys
+
+AXES = ("funcs", "length", "depth", "expr", "garray", "larray")
+
+
+def gen_funcs(n):
+    out = []
+    for k in range(n):
+        out.append("int f%d(int a, int b) {\n"
+                   "    int x = a + b * %d;\n"
+                   "    if (x > %d) x = x - %d;\n"
+                   "    return x %% 1000;\n"
+                   "}\n" % (k, k % 7 + 1, k, k))
+    out.append("int main() {\n    int s = 0;\n")
+    for k in range(n):
+        out.append("    s = f%d(s, %d);\n" % (k, k))
+    out.append("    putint(s);\n    return 0;\n}\n")
+    return "".join(out)
+
+
+def gen_length(n):
+    out = ["int main() {\n    int x = 1, y = 2;\n"]
+    for k in range(n):
+        if k % 3 == 0:
+            out.append("    x = (x * 3 + y) %% 1000 + %d;\n" % k)
+        elif k % 3 == 1:
+            out.append("    y = y + x / 7 - %d;\n" % (k % 13))
+        else:
+            out.append("    if (x < y) x = x + 1;\n")
+    out.append("    putint(x + y);\n    return 0;\n}\n")
+    return "".join(out)
+
+
+def gen_depth(n):
+    # Every level declares a variable and reads the outermost one, so each lookup walks
+    # the whole scope stack.
+    out = ["int main() {\n    int v0 = 1;\n"]
+    for d in range(1, n + 1):
+        ind = "    " * d
+        out.append("%s{\n%s    int v%d = v%d + v0;\n" % (ind, ind, d, d - 1))
+    out.append("    " * (n + 1) + "putint(v%d);\n" % n)
+    for d in range(n, 0, -1):
+        out.append("    " * d + "}\n")
+    out.append("    return 0;\n}\n")
+    return "".join(out)
+
+
+def gen_expr(n):
+    # A left-associated chain: the AST is n levels deep while the parser stack stays flat.
+    ops = ("+", "*", "-", "/", "%")
+    terms = ["a"]
+    for k in range(n):
+        op = ops[k % len(ops)]
+        rhs = "b" if op in "+-*" else str(k % 9 + 1)
+        terms.append(" %s %s" % (op, rhs))
+    return ("int main() {\n    int a = getint(), b = 3;\n    int r = %s;\n"
+            "    putint(r);\n    return 0;\n}\n" % "".join(terms))
+
+
+def init_list(n):
+    # Explicit values for the first half, the rest is implicitly zero.
+    return ", ".join(str(k % 97) for k in range(n // 2))
+
+
+def gen_garray(n):
+    return ("int g[%d] = {%s};\n"
+            "int main() {\n    putint(g[%d]);\n    return 0;\n}\n" % (n, init_list(n), n // 3))
+
+
+def gen_larray(n):
+    return ("int main() {\n    int l[%d] = {%s};\n"
+            "    putint(l[%d]);\n    return 0;\n}\n" % (n, init_list(n), n // 3))
+
+
+GENERATORS = {
+    "funcs": gen_funcs,
+    "length": gen_length,
+    "depth": gen_depth,
+    "expr": gen_expr,
+    "garray": gen_garray,
+    "larray": gen_larray,
+}
+
+
+def generate(axis, n):
+    return GENERATORS[axis](n)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate a synthetic SysY program.")
+    parser.add_argument("axis", choices=AXES)
+    parser.add_argument("n", type=int, help="size along the axis")
+    parser.add_argument("-o", "--output", help="output file (default: stdout)")
+    args = parser.parse_args()
+    text = generate(args.axis, args.n)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,207 @@
+#!/usr/bin/env python3
+"""Runtime benchmark of -perf output under a local RISC-V emulator.
+
+Every program of the corpus (bench/perf/*.sy by default) is compiled with `-perf`,
+assembled and linked against the SysY runtime, and run under QEMU user mode. Output and
+exit code are checked against `<name>.out` when it exists, else against `-interp -O0` of
+--compiler (the program as the front end builds it, none of the passes under test), computed
+once and used for the --baseline build as well. Recorded per program: time (the runtime's
+starttime/stoptime total when the program reports one, else wall time of the emulator,
+fastest of --repeat runs) and retired instructions (with --qemu-plugin pointing at QEMU's
+libinsn.so).
+
+With --baseline, the same is done with a second compiler build and a comparison table is
+printed.
+
+Usage: run_perf.py --compiler build/compiler [--baseline old/compiler] [--corpus DIR]
+                   [--out DIR] [--sysy-lib DIR] [--qemu-plugin libinsn.so] [--repeat 3]
+
+The defaults follow the course toolchain: clang for riscv32, ld.lld, qemu-riscv32-static and
+libsysy.a from $CDE_LIBRARY_PATH/riscv32.
+"""
+
+import argparse
+import csv
+import glob
+import os
+import re
+import subprocess
+import sys
+import time
+
+CLANG_FLAGS = ["-target", "riscv32-unknown-linux-elf", "-march=rv32im", "-mabi=ilp32"]
+
+
+class Failure(Exception):
+    pass
+
+
+def run(cmd, stdin=None, timeout=None):
+    """Run `cmd`, returns (exit status, stdout, stderr, seconds)."""
+    start = time.perf_counter()
+    proc = subprocess.run(cmd, stdin=stdin, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                          timeout=timeout)
+    return (proc.returncode, proc.stdout.decode(errors="replace"),
+            proc.stderr.decode(errors="replace"), time.perf_counter() - start)
+
+
+def run_with_input(cmd, src, timeout=None):
+    """`run` with `<name>.in` of the program `src` as stdin, if there is one."""
+    path = os.path.splitext(src)[0] + ".in"
+    if not os.path.exists(path):
+        return run(cmd, stdin=subprocess.DEVNULL, timeout=timeout)
+    with open(path, "rb") as f:
+        return run(cmd, stdin=f, timeout=timeout)
+
+
+def expected_output(compiler, src, work):
+    """Expected stdout followed by the exit code, in the format of the SysY test cases."""
+    path = os.path.splitext(src)[0] + ".out"
+    if os.path.exists(path):
+        with open(path) as f:
+            return f.read()
+    os.makedirs(work, exist_ok=True)
+    report = os.path.join(work, "interp.txt")
+    status, out, err, _ = run_with_input([compiler, "-interp", src, "-o", report, "-O0"], src)
+    if not os.path.exists(report):
+        raise Failure("-interp failed: " + err.strip())
+    return join_output(out, status)
+
+
+def join_output(out, status):
+    if out and not out.endswith("\n"):
+        out += "\n"
+    return out + str(status) + "\n"
+
+
+def timer_us(err):
+    """Total time reported by the runtime's stoptime(), in microseconds."""
+    m = re.search(r"TOTAL: (\d+)H-(\d+)M-(\d+)S-(\d+)us", err)
+    if not m:
+        return None
+    h, mi, s, us = (int(g) for g in m.groups())
+    return ((h * 60 + mi) * 60 + s) * 1000000 + us
+
+
+def build_and_run(args, compiler, src, expected, work):
+    """Returns (time in ms, instruction count or None)."""
+    os.makedirs(work, exist_ok=True)
+    asm = os.path.join(work, "prog.S")
+    obj = os.path.join(work, "prog.o")
+    exe = os.path.join(work, "prog")
+    status, _, err, _ = run([compiler, "-perf", src, "-o", asm])
+    if status != 0:
+        raise Failure("compile failed: " + err.strip())
+    status, _, err, _ = run([args.cc] + CLANG_FLAGS + ["-c", asm, "-o", obj])
+    if status != 0:
+        raise Failure("assemble failed: " + err.strip())
+    status, _, err, _ = run([args.ld, obj, "-L" + args.sysy_lib, "-lsysy", "-o", exe])
+    if status != 0:
+        raise Failure("link failed: " + err.strip())
+
+    best = None
+    for _ in range(args.repeat):
+        status, out, err, wall = run_with_input([args.qemu, exe], src, timeout=args.timeout)
+        if join_output(out, status).split() != expected.split():
+            raise Failure("wrong output (exit code %d)" % status)
+        us = timer_us(err)
+        ms = us / 1000.0 if us is not None else wall * 1000
+        best = ms if best is None else min(best, ms)
+
+    insns = None
+    if args.qemu_plugin:
+        log = os.path.join(work, "insn.log")
+        run_with_input([args.qemu, "-plugin", args.qemu_plugin, "-d", "plugin", "-D", log, exe],
+                       src, timeout=args.timeout)
+        with open(log) as f:
+            m = re.search(r"insns: (\d+)", f.read())
+        insns = int(m.group(1)) if m else None
+    return best, insns
+
+
+def reference(args, programs):
+    """Expected output of every program (None if it can't be had), shared by both builds."""
+    results = {}
+    for src in programs:
+        name = os.path.splitext(os.path.basename(src))[0]
+        try:
+            results[src] = expected_output(args.compiler, src, os.path.join(args.out, "ref", name))
+        except (Failure, OSError, subprocess.TimeoutExpired) as e:
+            results[src] = None
+            print("ref: %s: %s" % (name, e), file=sys.stderr)
+    return results
+
+
+def bench(args, compiler, tag, programs, expected):
+    results = {}
+    for src in programs:
+        name = os.path.splitext(os.path.basename(src))[0]
+        if expected[src] is None:
+            results[name] = None
+            continue
+        try:
+            results[name] = build_and_run(args, compiler, src, expected[src], os.path.join(args.out, tag, name))
+        except (Failure, OSError, subprocess.TimeoutExpired) as e:
+            results[name] = None
+            print("%s: %s: %s" % (tag, name, e), file=sys.stderr)
+    return results
+
+
+def fmt(v, spec):
+    return spec % v if v is not None else "-"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Runtime benchmark of -perf output.")
+    parser.add_argument("--compiler", required=True)
+    parser.add_argument("--baseline", help="second compiler build to compare against")
+    parser.add_argument("--corpus", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "perf"))
+    parser.add_argument("--out", default="perf_out")
+    parser.add_argument("--sysy-lib", default=os.path.join(os.environ.get("CDE_LIBRARY_PATH", "/opt/lib"), "riscv32"),
+                        help="directory of libsysy.a")
+    parser.add_argument("--cc", default="clang")
+    parser.add_argument("--ld", default="ld.lld")
+    parser.add_argument("--qemu", default="qemu-riscv32-static")
+    parser.add_argument("--qemu-plugin", help="QEMU libinsn.so, enables retired instruction counts")
+    parser.add_argument("--repeat", type=int, default=3, help="runs per program, the fastest is kept")
+    parser.add_argument("--timeout", type=float, default=300)
+    args = parser.parse_args()
+
+    programs = sorted(glob.glob(os.path.join(args.corpus, "*.sy")) + glob.glob(os.path.join(args.corpus, "*.c")))
+    if not programs:
+        print("no programs in " + args.corpus, file=sys.stderr)
+        return 1
+    os.makedirs(args.out, exist_ok=True)
+    expected = reference(args, programs)
+    new = bench(args, args.compiler, "new", programs, expected)
+    old = bench(args, args.baseline, "base", programs, expected) if args.baseline else {}
+
+    rows = []
+    header = "%-16s %12s %14s" % ("program", "time (ms)", "instructions")
+    if args.baseline:
+        header += " %12s %14s %8s" % ("base (ms)", "base insns", "speedup")
+    print(header)
+    for name in sorted(new):
+        r, b = new[name], old.get(name)
+        row = {"program": name,
+               "time_ms": fmt(r and r[0], "%.3f"), "insns": fmt(r and r[1], "%d"),
+               "base_time_ms": fmt(b and b[0], "%.3f"), "base_insns": fmt(b and b[1], "%d")}
+        line = "%-16s %12s %14s" % (name, row["time_ms"], row["insns"])
+        if args.baseline:
+            speedup = b[0] / r[0] if r and b and r[0] > 0 else None
+            row["speedup"] = fmt(speedup, "%.3f")
+            line += " %12s %14s %8s" % (row["base_time_ms"], row["base_insns"], row["speedup"])
+        rows.append(row)
+        print(line)
+
+    with open(os.path.join(args.out, "run_perf.csv"), "w", newline="") as f:
+        fields = ["program", "time_ms", "insns", "base_time_ms", "base_insns", "speedup"]
+        writer = csv.DictWriter(f, fieldnames=fields, restval="")
+        writer.writeheader()
+        writer.writerows(rows)
+    failed = any(v is None for v in list(new.values()) + list(old.values()))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
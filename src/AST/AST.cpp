@@ -1,10 +1,12 @@
 #include "AST/AST.hpp"
 Block BaseAST::big_block;
 SymbolTab BaseAST::sym_tab;
+bool BaseAST::runtime = false;
 LoopMaintainer BaseAST::loop_maintainer;
 
 char *new_char_arr(std::string str) {
     size_t n = str.length();
+    MemReport::Count(MemReport::String, n + 1);
     char *res = new char[n + 1];
     str.copy(res, n + 1);
     res[n] = 0;
@@ -24,8 +26,8 @@ void CompUnitAST::add_lib_funcs(std::vector<const void*> &funcs) const {
     koopa_raw_type_kind_t *ty;
     std::vector<const void *> fparams;
 
-    func = new koopa_raw_function_data_t();
-    ty = new koopa_raw_type_kind_t();
+    func = new_koopa_raw_function();
+    ty = new_koopa_raw_type();
     ty->tag = KOOPA_RTT_FUNCTION;
     ty->data.function.params = empty_koopa_raw_slice(KOOPA_RSIK_TYPE);
     ty->data.function.ret = simple_koopa_raw_type_kind(KOOPA_RTT_INT32);
@@ -36,8 +38,8 @@ void CompUnitAST::add_lib_funcs(std::vector<const void*> &funcs) const {
     sym_tab.AddSymbol("getint", LValSymbol(LValSymbol::Function, func));
     funcs.push_back(func);
 
-    func = new koopa_raw_function_data_t();
-    ty = new koopa_raw_type_kind_t();
+    func = new_koopa_raw_function();
+    ty = new_koopa_raw_type();
     ty->tag = KOOPA_RTT_FUNCTION;
     ty->data.function.params = empty_koopa_raw_slice(KOOPA_RSIK_TYPE);
     ty->data.function.ret = simple_koopa_raw_type_kind(KOOPA_RTT_INT32);
@@ -48,8 +50,8 @@ void CompUnitAST::add_lib_funcs(std::vector<const void*> &funcs) const {
     sym_tab.AddSymbol("getch", LValSymbol(LValSymbol::Function, func));
     funcs.push_back(func);
 
-    func = new koopa_raw_function_data_t();
-    ty = new koopa_raw_type_kind_t();
+    func = new_koopa_raw_function();
+    ty = new_koopa_raw_type();
     ty->tag = KOOPA_RTT_FUNCTION;
     fparams.clear();
     fparams.push_back(make_int_pointer_type());
@@ -63,8 +65,8 @@ void CompUnitAST::add_lib_funcs(std::vector<const void*> &funcs) const {
     sym_tab.AddSymbol("getarray", LValSymbol(LValSymbol::Function, func));
     funcs.push_back(func);
 
-    func = new koopa_raw_function_data_t();
-    ty = new koopa_raw_type_kind_t();
+    func = new_koopa_raw_function();
+    ty = new_koopa_raw_type();
     ty->tag = KOOPA_RTT_FUNCTION;
     fparams.clear();
     fparams.push_back(simple_koopa_raw_type_kind(KOOPA_RTT_INT32));
@@ -77,8 +79,8 @@ void CompUnitAST::add_lib_funcs(std::vector<const void*> &funcs) const {
     sym_tab.AddSymbol("putint", LValSymbol(LValSymbol::Function, func));
     funcs.push_back(func);
 
-    func = new koopa_raw_function_data_t();
-    ty = new koopa_raw_type_kind_t();
+    func = new_koopa_raw_function();
+    ty = new_koopa_raw_type();
     ty->tag = KOOPA_RTT_FUNCTION;
     fparams.clear();
     fparams.push_back(simple_koopa_raw_type_kind(KOOPA_RTT_INT32));
@@ -91,8 +93,8 @@ void CompUnitAST::add_lib_funcs(std::vector<const void*> &funcs) const {
     sym_tab.AddSymbol("putch", LValSymbol(LValSymbol::Function, func));
     funcs.push_back(func);
 
-    func = new koopa_raw_function_data_t();
-    ty = new koopa_raw_type_kind_t();
+    func = new_koopa_raw_function();
+    ty = new_koopa_raw_type();
     ty->tag = KOOPA_RTT_FUNCTION;
     fparams.clear();
     fparams.push_back(simple_koopa_raw_type_kind(KOOPA_RTT_INT32));
@@ -107,8 +109,8 @@ void CompUnitAST::add_lib_funcs(std::vector<const void*> &funcs) const {
     sym_tab.AddSymbol("putarray", LValSymbol(LValSymbol::Function, func));
     funcs.push_back(func);
 
-    func = new koopa_raw_function_data_t();
-    ty = new koopa_raw_type_kind_t();
+    func = new_koopa_raw_function();
+    ty = new_koopa_raw_type();
     ty->tag = KOOPA_RTT_FUNCTION;
     ty->data.function.params = empty_koopa_raw_slice(KOOPA_RSIK_TYPE);
     ty->data.function.ret = simple_koopa_raw_type_kind(KOOPA_RTT_UNIT);
@@ -119,8 +121,8 @@ void CompUnitAST::add_lib_funcs(std::vector<const void*> &funcs) const {
     sym_tab.AddSymbol("starttime", LValSymbol(LValSymbol::Function, func));
     funcs.push_back(func);
 
-    func = new koopa_raw_function_data_t();
-    ty = new koopa_raw_type_kind_t();
+    func = new_koopa_raw_function();
+    ty = new_koopa_raw_type();
     ty->tag = KOOPA_RTT_FUNCTION;
     ty->data.function.params = empty_koopa_raw_slice(KOOPA_RSIK_TYPE);
     ty->data.function.ret = simple_koopa_raw_type_kind(KOOPA_RTT_UNIT);
@@ -130,6 +132,42 @@ void CompUnitAST::add_lib_funcs(std::vector<const void*> &funcs) const {
     func->bbs = empty_koopa_raw_slice(KOOPA_RSIK_BASIC_BLOCK);
     sym_tab.AddSymbol("stoptime", LValSymbol(LValSymbol::Function, func));
     funcs.push_back(func);
+
+    // 编译器自己的运行时, 后端随生成的代码一起输出 (见 `koopa2RISCV::emit_runtime`):
+    // 按字清零/填充 n 个 int, 按字复制 n 个 int (不重叠)
+    if (!runtime)
+        return;
+    func = new_koopa_raw_function();
+    ty = new_koopa_raw_type();
+    ty->tag = KOOPA_RTT_FUNCTION;
+    fparams.clear();
+    fparams.push_back(make_int_pointer_type());
+    fparams.push_back(simple_koopa_raw_type_kind(KOOPA_RTT_INT32));
+    fparams.push_back(simple_koopa_raw_type_kind(KOOPA_RTT_INT32));
+    ty->data.function.params = make_koopa_raw_slice(fparams, KOOPA_RSIK_TYPE);
+    ty->data.function.ret = simple_koopa_raw_type_kind(KOOPA_RTT_UNIT);
+    func->ty = ty;
+    func->name = "@__sysy_memset32";
+    func->params = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
+    func->bbs = empty_koopa_raw_slice(KOOPA_RSIK_BASIC_BLOCK);
+    sym_tab.AddSymbol("__sysy_memset32", LValSymbol(LValSymbol::Function, func));
+    funcs.push_back(func);
+
+    func = new_koopa_raw_function();
+    ty = new_koopa_raw_type();
+    ty->tag = KOOPA_RTT_FUNCTION;
+    fparams.clear();
+    fparams.push_back(make_int_pointer_type());
+    fparams.push_back(make_int_pointer_type());
+    fparams.push_back(simple_koopa_raw_type_kind(KOOPA_RTT_INT32));
+    ty->data.function.params = make_koopa_raw_slice(fparams, KOOPA_RSIK_TYPE);
+    ty->data.function.ret = simple_koopa_raw_type_kind(KOOPA_RTT_UNIT);
+    func->ty = ty;
+    func->name = "@__sysy_memcpy32";
+    func->params = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
+    func->bbs = empty_koopa_raw_slice(KOOPA_RSIK_BASIC_BLOCK);
+    sym_tab.AddSymbol("__sysy_memcpy32", LValSymbol(LValSymbol::Function, func));
+    funcs.push_back(func);
 }
 
 CompUnitAST::CompUnitAST(std::vector<BaseAST*> &_func_list, InstSet &_value_list) {
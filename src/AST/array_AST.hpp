@@ -2,6 +2,7 @@
 #ifndef ARRAY_AST_H
 #define ARRAY_AST_H
 #include "AST/base_AST.hpp"
+#include "utils/const_init.hpp"
 #include "utils/koopa_util.hpp"
 
 class InitValAST : public BaseAST
@@ -14,7 +15,6 @@ class InitValAST : public BaseAST
     std::vector<koopa_raw_value_t> cache;
 
 public:
-    bool is_const = false;
     ValType type;
     std::unique_ptr<BaseAST> exp;
     std::vector<std::unique_ptr<InitValAST>> arr_list;
@@ -31,27 +31,34 @@ public:
             arr_list.emplace_back(dynamic_cast<InitValAST*>(t));
     }
 
+    // 嵌套的 {...} 从已经填了 `filled` 个元素的位置开始, 对齐到比 `align_pos` 低的维度中
+    // 最大的一个能整除 `filled` 的, 局部数组和全局数组都按这个规则.
+    // 最低到单个元素 (pro 的最后一项), 标量外面的 {4} 就是 4
+    static int sub_align_pos(const std::vector<int> &pro, int align_pos, size_t filled)
+    {
+        int last = pro.size() - 1;
+        int res = std::min(align_pos + 1, last);
+        while(res < last && filled % pro[res] != 0)
+            res ++;
+        return res;
+    }
+
     void sub_preprocess(std::vector<int> &pro, int align_pos, std::vector<koopa_raw_value_t> &buf)
     {
-        int target_size = buf.size() + pro[align_pos];
+        size_t target_size = buf.size() + pro[align_pos];
         for(size_t i = 0; i < arr_list.size(); i++)
         {
             auto &t = arr_list[i];
             if(t->type == Exp)
             {
-                if(is_const)
-                    buf.push_back(make_koopa_interger(t->exp->CalcValue()));
-                else
-                    buf.push_back((koopa_raw_value_t)t->exp->build_koopa_values());
+                buf.push_back((koopa_raw_value_t)t->exp->build_koopa_values());
             }
             else
-            {
-                int new_align_pos = align_pos + 1;
-                while(cache.size() % pro[new_align_pos] != 0)
-                    new_align_pos ++;
-                arr_list[i]->sub_preprocess(pro, new_align_pos, buf);
-            }
+                arr_list[i]->sub_preprocess(pro, sub_align_pos(pro, align_pos, buf.size()), buf);
         }
+        // 多出来的元素丢掉, 和 sub_preprocess_const 一样
+        if(buf.size() > target_size)
+            buf.resize(target_size);
         while(buf.size() < target_size)
             buf.push_back(make_koopa_interger(0));
     }
@@ -65,56 +72,85 @@ public:
         sub_preprocess(pro, 0, cache);
     }
 
-    koopa_raw_value_t At(int idx)
+    // 全局数组的常量初始化: 只算出每个元素的值放进 `buf`, 不为每个元素创建 koopa 整数
+    void sub_preprocess_const(std::vector<int> &pro, int align_pos, std::vector<int32_t> &buf)
     {
-        if(type == Array)
-            return cache[idx];
-        else if(type == Exp)
-            return (koopa_raw_value_t)exp->build_koopa_values();
-        return nullptr;
-    }
-    
-    koopa_raw_value_t sub_make_aggerate(const std::vector<int> &sz, std::vector<int> &pro, int align_pos, std::vector<koopa_raw_value_t> &buf, int st_pos)
-    {
-        if(pro[align_pos] == 1)
-            return buf[st_pos];
-        koopa_raw_value_data *res = 
-        Init(make_array_type(sz, align_pos),
-            nullptr,
-            empty_koopa_raw_slice(KOOPA_RSIK_VALUE),
-            make_koopa_raw_value_kind(KOOPA_RVT_AGGREGATE)
-        );
-
-        std::vector<const void*> elements;
-        for(int i = 0; i < sz[align_pos]; i++)
-            elements.push_back(sub_make_aggerate(sz, pro, align_pos + 1, buf, st_pos + pro[align_pos + 1] * i));
-        res->kind.data.aggregate.elems = make_koopa_raw_slice(elements, KOOPA_RSIK_VALUE); //make koopa raw slice from vector
-        return res;
+        size_t target_size = buf.size() + pro[align_pos];
+        for(size_t i = 0; i < arr_list.size(); i++)
+        {
+            auto &t = arr_list[i];
+            if(t->type == Exp)
+                buf.push_back(t->exp->CalcValue());
+            else
+                arr_list[i]->sub_preprocess_const(pro, sub_align_pos(pro, align_pos, buf.size()), buf);
+        }
+        buf.resize(target_size, 0);
     }
 
-    koopa_raw_value_t make_aggerate(const std::vector<int> &sz)
+    void preprocess_const(const std::vector<int> &sz, std::vector<int32_t> &buf)
     {
         std::vector<int> pro(sz.size() + 1);
         pro[sz.size()] = 1;
         for(int i = sz.size() - 1; i >= 0; i--)
             pro[i] = pro[i + 1] * sz[i];
-        return sub_make_aggerate(sz, pro, 0, cache, 0);
+        buf.reserve(pro[0]);
+        sub_preprocess_const(pro, 0, buf);
+    }
+
+    koopa_raw_value_t At(int idx)
+    {
+        if(type == Array)
+            return cache[idx];
+        else if(type == Exp)
+            return (koopa_raw_value_t)exp->build_koopa_values();
+        return nullptr;
     }
 };
 
 class ArrayDefAST : public BaseAST {
-    koopa_raw_value_data *get_index(int i, std::vector<int> &pro, koopa_raw_value_data *src, int cur_pos = 0) const {
-        if(cur_pos >= pro.size())
-            return src;
-        koopa_raw_type_kind *ty = new koopa_raw_type_kind();
-        ty->tag = KOOPA_RTT_POINTER;
-        ty->data.pointer.base = src->ty->data.pointer.base->data.array.base;
-        koopa_raw_value_data *get = 
-        Init(ty, nullptr, empty_koopa_raw_slice(KOOPA_RSIK_VALUE),
-            make_koopa_raw_value_kind(KOOPA_RVT_GET_ELEM_PTR, 0, src, make_koopa_interger(i / pro[cur_pos]))
-        );
-        big_block.Push_back(get);
-        return get_index(i % pro[cur_pos], pro, get, cur_pos + 1);
+    // 零元素多于这个数时, 先把整个数组清零, 之后只存非零元素
+    static const int ZERO_FILL_THRESHOLD = 64;
+
+    // 把 `base` (*i32) 开始的 `n` 个元素清零: 有运行时 (见 `BaseAST::runtime`) 时调用
+    // `@__sysy_memset32`, 它按字展开; 否则
+    //   store 0, %i; jump %zero_fill
+    //   %zero_fill: %p = getptr base, %i; store 0, %p ... (展开 unroll 次); %i += unroll; br %i < n
+    // n > 0, 所以直接写成 do-while 的形式.
+    void zero_fill(koopa_raw_value_t base, int n) const {
+        if (runtime) {
+            koopa_raw_function_t memset = (koopa_raw_function_t)sym_tab.GetSymbol("__sysy_memset32").number;
+            big_block.Push_back(CallInst(memset, {base, make_koopa_interger(0), make_koopa_interger(n)}));
+            return;
+        }
+        int unroll = n % 4 == 0 ? 4 : n % 2 == 0 ? 2 : 1;
+        koopa_raw_value_data *counter = AllocIntInst("@zero_fill_i");
+        big_block.Push_back(counter);
+        big_block.Push_back(StoreInst(make_koopa_interger(0), counter));
+        koopa_raw_basic_block_data_t *body = BasicBlock("%zero_fill");
+        koopa_raw_basic_block_data_t *end = BasicBlock("%zero_fill_end");
+        big_block.Push_back(JumpInst(body));
+        big_block.Push_back(body);
+
+        koopa_raw_value_data *i = LoadInst(counter);
+        big_block.Push_back(i);
+        koopa_raw_value_data *p = GetPtrInst(base, i);
+        big_block.Push_back(p);
+        for (int k = 0; k < unroll; k++) {
+            koopa_raw_value_t dest = p;
+            if (k > 0) {
+                koopa_raw_value_data *q = GetPtrInst(p, make_koopa_interger(k));
+                big_block.Push_back(q);
+                dest = q;
+            }
+            big_block.Push_back(StoreInst(make_koopa_interger(0), dest));
+        }
+        koopa_raw_value_data *next = BinaryInst(KOOPA_RBO_ADD, i, make_koopa_interger(unroll));
+        big_block.Push_back(next);
+        big_block.Push_back(StoreInst(next, counter));
+        koopa_raw_value_data *cond = BinaryInst(KOOPA_RBO_LT, next, make_koopa_interger(n));
+        big_block.Push_back(cond);
+        big_block.Push_back(BranchInst(cond, body, end));
+        big_block.Push_back(end);
     }
 
 public:
@@ -146,9 +182,9 @@ public:
             sz.push_back(tmp);
         }
         
-        koopa_raw_value_data *res = new koopa_raw_value_data();
+        koopa_raw_value_data *res = new_koopa_raw_value();
         koopa_raw_type_kind *ty = make_array_type(sz);
-        koopa_raw_type_kind *tty = new koopa_raw_type_kind();
+        koopa_raw_type_kind *tty = new_koopa_raw_type();
         tty->tag = KOOPA_RTT_POINTER;
         tty->data.pointer.base = ty;
         res->ty = tty;
@@ -161,22 +197,32 @@ public:
         if(init_val)
         {
             init_val->preprocess(sz);
-            std::vector<int> pro(sz.size());
-            pro[sz.size() - 1] = 1;
-            for(int i = sz.size() - 2; i >= 0; i--)
-                pro[i] = pro[i + 1] * sz[i + 1];
+            // 退化为 *i32, 元素 i 的地址就是 getptr base, i (常数下标, 后端里是静态地址)
+            koopa_raw_value_t base = res;
+            while(base->ty->data.pointer.base->tag == KOOPA_RTT_ARRAY)
+            {
+                koopa_raw_value_data *decay = GetElemPtrInst(base, make_koopa_interger(0));
+                big_block.Push_back(decay);
+                base = decay;
+            }
+            std::vector<koopa_raw_value_t> vals;
+            int zeros = 0;
             for(int i = 0; i < total_size; i++)
             {
-                koopa_raw_value_data *get = get_index(i, pro, res);
-
-                koopa_raw_value_data *st = new koopa_raw_value_data();
-                st->ty = simple_koopa_raw_type_kind(KOOPA_RTT_UNIT);
-                st->name = nullptr;
-                st->used_by = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
-                st->kind.tag = KOOPA_RVT_STORE;
-                st->kind.data.store.dest = get;
-                st->kind.data.store.value = init_val->At(i);
-                big_block.Push_back(st);
+                vals.push_back(init_val->At(i));
+                if(vals[i]->kind.tag == KOOPA_RVT_INTEGER && vals[i]->kind.data.integer.value == 0)
+                    zeros++;
+            }
+            bool filled = zeros > ZERO_FILL_THRESHOLD;
+            if(filled)
+                zero_fill(base, total_size);
+            for(int i = 0; i < total_size; i++)
+            {
+                if(filled && vals[i]->kind.tag == KOOPA_RVT_INTEGER && vals[i]->kind.data.integer.value == 0)
+                    continue;
+                koopa_raw_value_data *get = GetPtrInst(base, make_koopa_interger(i));
+                big_block.Push_back(get);
+                big_block.Push_back(StoreInst(vals[i], get));
             }
         }
         return res;
@@ -200,23 +246,23 @@ public:
         std::vector<int> sz;
         for(auto &exp : sz_exp)
             sz.push_back(exp->CalcValue());
-        koopa_raw_value_data *res = new koopa_raw_value_data();
+        koopa_raw_value_data *res = new_koopa_raw_value();
         koopa_raw_type_kind *ty = make_array_type(sz);
-        koopa_raw_type_kind *tty = new koopa_raw_type_kind();
+        koopa_raw_type_kind *tty = new_koopa_raw_type();
         tty->tag = KOOPA_RTT_POINTER;
         tty->data.pointer.base = ty;
         res->ty = tty;
         res->name = new_char_arr("@" + name);
         res->used_by = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
         res->kind.tag = KOOPA_RVT_GLOBAL_ALLOC;
+        // 初始值放在 ConstInit 里, IR 中只是 zeroinit, 见 utils/const_init.hpp
+        res->kind.data.global_alloc.init = ZeroInit(ty);
         if(init_val)
         {
-            init_val->is_const = true;
-            init_val->preprocess(sz);
-            res->kind.data.global_alloc.init = init_val->make_aggerate(sz);
+            ConstInit &const_init = ConstInit::Add(res->name);
+            init_val->preprocess_const(sz, const_init.data);
+            const_init.BuildRuns();
         }
-        else
-            res->kind.data.global_alloc.init = ZeroInit(ty);
         sym_tab.AddSymbol(name, LValSymbol(LValSymbol::Array, res));
 
         return res;
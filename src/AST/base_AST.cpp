@@ -0,0 +1,14 @@
+#include "AST/base_AST.hpp"
+
+void *BaseAST::operator new(size_t sz) {
+    MemReport::Count(MemReport::AstNode, sz);
+    return ::operator new(sz);
+}
+
+void BaseAST::operator delete(void *p) {
+    ::operator delete(p);
+}
+
+void BaseAST::operator delete(void *p, size_t) {
+    ::operator delete(p);
+}
@@ -12,6 +12,7 @@
 #include "symbol_tab.hpp"
 #include "utils/block.hpp"
 #include "utils/loop_maintainer.hpp"
+#include "utils/mem_report.hpp"
 
 //char *new_char_arr(std::string str);
 
@@ -21,14 +22,28 @@ public:
     static SymbolTab sym_tab;
     static Block big_block;
     static LoopMaintainer loop_maintainer;
+    // 是否可以调用编译器自己的运行时 (@__sysy_memset32 等): 只有 RISC-V 后端会输出它们,
+    // -koopa 输出的 IR 要能直接和 libsysy 链接
+    static bool runtime;
 
     virtual ~BaseAST() = default;
+    // 所有AST节点都由此分配，以便 -mem-report 按节点种类统计.
+    // 和 delete 一起定义在 base_AST.cpp 里: 内联到调用处后, GCC 会把类的 new 和全局的
+    // delete 当作不配对的分配/释放 (-Wmismatched-new-delete)
+    static void *operator new(size_t sz);
+    static void operator delete(void *p);
+    static void operator delete(void *p, size_t);
     // 输出koopa对象，并在全局环境添加各种信息
     virtual void *build_koopa_values() const {
         std::cerr << "Not Implement build_koopa_values" << std::endl;
         assert(false);
         return nullptr;
     }
+    // 把表达式作为条件翻译成跳转: 非零时跳到 true_bb, 否则跳到 false_bb.
+    // 默认先求值再 br, 逻辑运算符在子类中直接生成短路跳转, 不物化布尔值
+    virtual void build_koopa_branch(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) const {
+        big_block.Push_back(BranchInst((koopa_raw_value_t)build_koopa_values(), true_bb, false_bb));
+    }
     // 用于表达式AST求值
     virtual int CalcValue() const {
         std::cerr << "Not Implement CalcValue" << std::endl;
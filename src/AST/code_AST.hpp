@@ -5,6 +5,7 @@
 
 #include "AST/base_AST.hpp"
 #include "utils/koopa_util.hpp"
+#include "utils/time_report.hpp"
 
 enum InstType {
     ConstDecl,
@@ -21,7 +22,8 @@ typedef std::vector<std::pair<InstType, std::unique_ptr<BaseAST>>> InstSet;
 
 // CompUnit 是 BaseAST
 class CompUnitAST : public BaseAST {
-    // 把一些启动时就需要的库函数的符号等加入其中，包括@getint, @getch, @getarray, @putch, @putarray, @starttime, @stoptime
+    // 把一些启动时就需要的库函数的符号等加入其中，包括@getint, @getch, @getarray, @putch, @putarray, @starttime, @stoptime,
+    // 以及 `runtime` 时编译器自己的运行时 @__sysy_memset32, @__sysy_memcpy32
     void add_lib_funcs(std::vector<const void*> &funcs) const;
 public:
     // 用智能指针管理对象
@@ -108,7 +110,7 @@ public:
                 for(auto &exp : sz_exp)
                     sz.push_back(exp->CalcValue());
                 koopa_raw_type_kind *ty = make_array_type(sz);
-                koopa_raw_type_kind *koopa_type = new koopa_raw_type_kind();
+                koopa_raw_type_kind *koopa_type = new_koopa_raw_type();
                 koopa_type->tag = KOOPA_RTT_POINTER;
                 koopa_type->data.pointer.base = ty;
                 return koopa_type;
@@ -182,10 +184,11 @@ public:
     ~FuncDefAST() = default;
 
     void *build_koopa_values() const override {
-        koopa_raw_function_data_t *res = new koopa_raw_function_data_t();
+        PhaseScope phase("lower function", ident.c_str());
+        koopa_raw_function_data_t *res = new_koopa_raw_function();
         sym_tab.AddSymbol(ident, LValSymbol(LValSymbol::SymbolType::Function, res));
 
-        koopa_raw_type_kind_t *ty = new koopa_raw_type_kind_t();
+        koopa_raw_type_kind_t *ty = new_koopa_raw_type();
         ty->tag = KOOPA_RTT_FUNCTION;
         std::vector<const void*> pair;
         for(auto &fp : fparams)
@@ -205,7 +208,7 @@ public:
         std::vector<const void *> blocks;
         big_block.SetBasicBlockBuf(&blocks);
         // Create new entry block
-        koopa_raw_basic_block_data_t *entry_block = new koopa_raw_basic_block_data_t();
+        koopa_raw_basic_block_data_t *entry_block = new_koopa_raw_basic_block();
         entry_block->name = new_char_arr("%entry_" + ident);
         entry_block->params = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
         entry_block->used_by = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
@@ -299,7 +302,7 @@ class BranchAST : public BaseAST {
 private:
     // koopa_raw_slice_t _instructions = {nullptr, 0, KOOPA_RSIK_BASIC_BLOCK};
     koopa_raw_basic_block_data_t *bb_init(const char *_name, koopa_raw_slice_t _params, koopa_raw_slice_t _used_by, koopa_raw_slice_t _insts = {nullptr, 0, KOOPA_RSIK_BASIC_BLOCK}) const {
-        koopa_raw_basic_block_data_t *res = new koopa_raw_basic_block_data_t();
+        koopa_raw_basic_block_data_t *res = new_koopa_raw_basic_block();
         res->name = _name;
         res->params = _params;
         res->used_by = _used_by;
@@ -324,15 +327,6 @@ public:
         exp = std::move(_exp);
     }
     void *build_koopa_values() const override {
-        koopa_raw_value_data *res = 
-            Init(simple_koopa_raw_type_kind(KOOPA_RTT_UNIT),
-                nullptr,
-                empty_koopa_raw_slice(KOOPA_RSIK_VALUE),
-                make_koopa_raw_value_kind(KOOPA_RVT_BRANCH)
-                );
-        koopa_raw_branch_t &branch = res->kind.data.branch;
-        branch.cond = (koopa_raw_value_t)exp->build_koopa_values();
-       
         koopa_raw_basic_block_data_t *true_block =
             bb_init(
                 new_char_arr("%true"),
@@ -351,13 +345,9 @@ public:
                 empty_koopa_raw_slice(KOOPA_RSIK_VALUE),
                 empty_koopa_raw_slice(KOOPA_RSIK_VALUE)
             );
-        
-        
-        branch.true_bb = true_block;
-        branch.true_args = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
-        branch.false_bb = false_block;
-        branch.false_args = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
-        big_block.Push_back(res);
+
+        // 条件直接翻译成跳转, && / || 短路求值时不再经过临时变量
+        exp->build_koopa_branch(true_block, false_block);
 
         // true
         big_block.Push_back(true_block);
@@ -379,7 +369,7 @@ public:
 class WhileAST : public BaseAST {
 private:
     koopa_raw_basic_block_data_t *bb_init(const char *_name, koopa_raw_slice_t _params, koopa_raw_slice_t _used_by, koopa_raw_slice_t _insts = {nullptr, 0, KOOPA_RSIK_BASIC_BLOCK}) const {
-        koopa_raw_basic_block_data_t *res = new koopa_raw_basic_block_data_t();
+        koopa_raw_basic_block_data_t *res = new_koopa_raw_basic_block();
         res->name = _name;
         res->params = _params;
         res->used_by = _used_by;
@@ -414,26 +404,18 @@ public:
             );
         loop_maintainer.AddLoop(while_entry, while_block, end_block);
 
-        big_block.Push_back(JumpInst(while_entry));
-        big_block.Push_back(while_entry);
-
-        koopa_raw_value_data *br = Init(simple_koopa_raw_type_kind(KOOPA_RTT_UNIT),
-            nullptr,
-            empty_koopa_raw_slice(KOOPA_RSIK_VALUE),
-            make_koopa_raw_value_kind(KOOPA_RVT_BRANCH)
-        );
-        koopa_raw_branch_t &branch = br->kind.data.branch;
-        branch.cond = (koopa_raw_value_t)exp->build_koopa_values();
-        branch.true_bb = while_block;
-        branch.false_bb = end_block;
-        branch.true_args = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
-        branch.false_args = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
-        big_block.Push_back(br);
+        // 循环被旋转成 if (cond) do { body } while (cond):
+        // 入口处判断一次, 条件再在循环体之后复制一份, 每次迭代只有一个跳回循环体的分支.
+        // continue 跳到 %while_entry, 也就是底部的条件.
+        exp->build_koopa_branch(while_block, end_block);
 
         big_block.Push_back(while_block);
         BlockAST::add_InstSet(this->body_insts);
         big_block.Push_back(JumpInst(while_entry));
 
+        big_block.Push_back(while_entry);
+        exp->build_koopa_branch(while_block, end_block);
+
         big_block.Push_back(end_block);
         
         loop_maintainer.PopLoop();
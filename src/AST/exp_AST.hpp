@@ -28,6 +28,15 @@ public:
     /*virtual*/ int CalcValue() const {
         return unaryExp->CalcValue();
     }
+    // 只有一个操作数的表达式把条件原样传给下一层, 直到遇到 && / || / !
+    void build_koopa_branch(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) const override {
+        if (unaryExp)
+            unaryExp->build_koopa_branch(true_bb, false_bb);
+        else if (type == Primary && leftExp)
+            leftExp->build_koopa_branch(true_bb, false_bb);
+        else
+            BaseAST::build_koopa_branch(true_bb, false_bb);
+    }
     /*virtual*/ void *koopa_leftvalue() const {
         std::cerr << "Not Implement koopa_leftvalue" << std::endl;
         assert(false);
@@ -59,8 +68,59 @@ public:
             idx.emplace_back(i);
     } 
 
+    // 能在编译期算出的地址运算就地折叠, 其余的加入 big_block
+    static koopa_raw_value_t emit_binary(koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs) {
+        koopa_raw_value_t res = FoldBinary(op, lhs, rhs);
+        if (!res) {
+            res = BinaryInst(op, lhs, rhs);
+            big_block.Push_back(res);
+        }
+        return res;
+    }
+    // 多维数组的元素访问 a[i][j][k] (所有下标都给出) 降为一个 getptr:
+    // 先把数组指针用常数 0 的 getelemptr 逐层退化为 *i32 (后端把它们折叠成静态地址),
+    // 再按 Horner 形式算出线性偏移 ((i * J) + j) * K + k, 常数下标在此折叠.
+    // 其他情况 (一维, 或只给出部分下标) 返回 nullptr, 由原来的逐层 getelemptr 处理.
+    koopa_raw_value_t flat_element_ptr() const {
+        auto var = sym_tab.GetSymbol(name);
+        if ((var.type != LValSymbol::Array && var.type != LValSymbol::Pointer) || idx.size() < 2)
+            return nullptr;
+        koopa_raw_value_t ptr = (koopa_raw_value_t)var.number;
+        bool is_param = ptr->ty->data.pointer.base->tag == KOOPA_RTT_POINTER;
+        // 第一个下标以下各层的长度
+        std::vector<int> dims;
+        koopa_raw_type_t ty = is_param ? ptr->ty->data.pointer.base->data.pointer.base
+                                       : ptr->ty->data.pointer.base->data.array.base;
+        for (; ty->tag == KOOPA_RTT_ARRAY; ty = ty->data.array.base)
+            dims.push_back(ty->data.array.len);
+        if (idx.size() != dims.size() + 1)
+            return nullptr;
+
+        if (is_param) {
+            koopa_raw_value_data *load = Init(ptr->ty->data.pointer.base, nullptr, empty_koopa_raw_slice(KOOPA_RSIK_VALUE),
+                make_koopa_raw_value_kind(KOOPA_RVT_LOAD, 0, ptr));
+            big_block.Push_back(load);
+            ptr = load;
+        }
+        koopa_raw_value_t offset = (koopa_raw_value_t)idx[0]->build_koopa_values();
+        for (size_t k = 0; k < dims.size(); ++k) {
+            koopa_raw_value_t sub = (koopa_raw_value_t)idx[k + 1]->build_koopa_values();
+            offset = emit_binary(KOOPA_RBO_ADD, emit_binary(KOOPA_RBO_MUL, offset, make_koopa_interger(dims[k])), sub);
+        }
+        while (ptr->ty->data.pointer.base->tag == KOOPA_RTT_ARRAY) {
+            koopa_raw_value_data *decay = GetElemPtrInst(ptr, make_koopa_interger(0));
+            big_block.Push_back(decay);
+            ptr = decay;
+        }
+        koopa_raw_value_data *get = GetPtrInst(ptr, offset);
+        big_block.Push_back(get);
+        return get;
+    }
+
         // 将变量作为左值返回（返回该左值的变量本身）
     void *koopa_leftvalue() const override {
+        if (koopa_raw_value_t elem = flat_element_ptr())
+            return (void *)elem;
         if(type == Array)  {
             koopa_raw_value_data *get;
             koopa_raw_value_t src = (koopa_raw_value_t)sym_tab.GetSymbol(name).number;
@@ -76,7 +136,7 @@ public:
                 bool first = true;
                 src = payload;
                 for(auto &i : idx) {
-                    koopa_raw_type_kind *ty = new koopa_raw_type_kind();
+                    koopa_raw_type_kind *ty = new_koopa_raw_type();
                     if(first) { // 对第一个单独处理
                         get = Init(src->ty, nullptr, empty_koopa_raw_slice(KOOPA_RSIK_VALUE),
                             make_koopa_raw_value_kind(KOOPA_RVT_GET_PTR, 0, src, (koopa_raw_value_t)i->build_koopa_values()));
@@ -96,7 +156,7 @@ public:
             }
             else { //其余情况，和对非第一个的处理是一样的。
                 for(auto &i : idx) {
-                    koopa_raw_type_kind *ty = new koopa_raw_type_kind();
+                    koopa_raw_type_kind *ty = new_koopa_raw_type();
                     // begin
                     ty->tag = KOOPA_RTT_POINTER;
                     ty->data.pointer.base = src->ty->data.pointer.base->data.array.base;
@@ -126,7 +186,7 @@ public:
     // - 如果变量是一个指针，函数会首先加载指针指向的值，然后根据索引来获取元素的指针，并可能需要加载元素的值。
 
     // 在处理过程中，函数会将创建的`koopa_raw_value_data`对象添加到`big_block`中。最后，函数返回创建的`koopa_raw_value_data`对象的指针。
-        koopa_raw_value_data *res = new koopa_raw_value_data();
+        koopa_raw_value_data *res = new_koopa_raw_value();
         auto var = sym_tab.GetSymbol(name);
         if (var.type == LValSymbol::Const)
             return (void *)var.number;
@@ -139,13 +199,21 @@ public:
 
             big_block.Push_back(res);
         }
+        else if (koopa_raw_value_t elem = flat_element_ptr()) {
+            delete res;
+            res = Init(simple_koopa_raw_type_kind(KOOPA_RTT_INT32),
+                    nullptr,
+                    empty_koopa_raw_slice(KOOPA_RSIK_VALUE),
+                    make_koopa_raw_value_kind(KOOPA_RVT_LOAD, 0, elem));
+            big_block.Push_back(res);
+        }
         else if (var.type == LValSymbol::Array) {
 
             bool need_load = false;
             koopa_raw_value_data *get;
             koopa_raw_value_data *src = (koopa_raw_value_data*)var.number;
             if (idx.empty()) {
-                koopa_raw_type_kind *ty = new koopa_raw_type_kind();
+                koopa_raw_type_kind *ty = new_koopa_raw_type();
                 ty->tag = KOOPA_RTT_POINTER;
                 ty->data.pointer.base = src->ty->data.pointer.base->data.array.base;
 
@@ -156,7 +224,7 @@ public:
             }
             else {
                 for(auto &i : idx) {
-                    koopa_raw_type_kind *ty = new koopa_raw_type_kind();
+                    koopa_raw_type_kind *ty = new_koopa_raw_type();
                     ty->tag = KOOPA_RTT_POINTER;
                     ty->data.pointer.base = src->ty->data.pointer.base->data.array.base;
 
@@ -179,7 +247,7 @@ public:
                 big_block.Push_back(res);
             }
             else if(src->ty->data.pointer.base->tag == KOOPA_RTT_ARRAY) {
-                koopa_raw_type_kind *ty = new koopa_raw_type_kind();
+                koopa_raw_type_kind *ty = new_koopa_raw_type();
                 ty->tag = KOOPA_RTT_POINTER;
                 ty->data.pointer.base = src->ty->data.pointer.base->data.array.base;
                 delete res;
@@ -203,8 +271,8 @@ public:
             koopa_raw_value_data *get;
             src = load0;
             for(auto &i : idx) {
-                //get = new koopa_raw_value_data();
-                koopa_raw_type_kind *ty = new koopa_raw_type_kind();
+                //get = new_koopa_raw_value();
+                koopa_raw_type_kind *ty = new_koopa_raw_type();
                 if(first) {
                     get = Init(src->ty, nullptr, empty_koopa_raw_slice(KOOPA_RSIK_VALUE),
                         make_koopa_raw_value_kind(KOOPA_RVT_GET_PTR, 0, src, (koopa_raw_value_t)i->build_koopa_values()));
@@ -230,7 +298,7 @@ public:
                 big_block.Push_back(res);
             }
             else if(src->ty->data.pointer.base->tag == KOOPA_RTT_ARRAY) {
-                koopa_raw_type_kind *ty = new koopa_raw_type_kind();
+                koopa_raw_type_kind *ty = new_koopa_raw_type();
                 ty->tag = KOOPA_RTT_POINTER;
                 ty->data.pointer.base = src->ty->data.pointer.base->data.array.base;
                 delete res;
@@ -261,6 +329,9 @@ public:
     void *build_koopa_values() const override {
         return nextExp->build_koopa_values();
     }
+    void build_koopa_branch(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) const override {
+        nextExp->build_koopa_branch(true_bb, false_bb);
+    }
     int CalcValue() const override {
         return nextExp->CalcValue();
     }
@@ -341,6 +412,14 @@ public:
         }
         return res;
     }
+    void build_koopa_branch(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) const override {
+        if (type == Primary)
+            nextExp->build_koopa_branch(true_bb, false_bb);
+        else if (type == Op && op == "!")
+            nextExp->build_koopa_branch(false_bb, true_bb);   // !x 只需交换两个目标
+        else
+            BaseAST::build_koopa_branch(true_bb, false_bb);
+    }
     int CalcValue() const override {
 
         if (type == Primary)
@@ -658,8 +737,8 @@ public:
                         );
                 koopa_raw_branch_t &branch = branching->kind.data.branch;
                 branch.cond = make_op_koopa((koopa_raw_value_t)leftExp->build_koopa_values(), KOOPA_RBO_NOT_EQ);
-                koopa_raw_basic_block_data_t *true_block = new koopa_raw_basic_block_data_t();
-                koopa_raw_basic_block_data_t *end_block = new koopa_raw_basic_block_data_t();
+                koopa_raw_basic_block_data_t *true_block = new_koopa_raw_basic_block();
+                koopa_raw_basic_block_data_t *end_block = new_koopa_raw_basic_block();
                 branch.true_bb = true_block;  // true basic block
                 branch.false_bb = end_block;  // false basic block, which is also the end part
                 branch.true_args = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
@@ -697,6 +776,17 @@ public:
         }
         return res;
     }
+    // a && b: a 为假直接跳到 false_bb, 否则进入 %land_rhs 再判断 b
+    void build_koopa_branch(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) const override {
+        if (type == Primary) {
+            leftExp->build_koopa_branch(true_bb, false_bb);
+            return;
+        }
+        koopa_raw_basic_block_data_t *rhs_block = BasicBlock("%land_rhs");
+        leftExp->build_koopa_branch(rhs_block, false_bb);
+        big_block.Push_back(rhs_block);
+        rightExp->build_koopa_branch(true_bb, false_bb);
+    }
     int CalcValue() const override {
         if (type == Primary)
             return leftExp->CalcValue();
@@ -771,8 +861,8 @@ public:
                         );
                 koopa_raw_branch_t &branch = branching->kind.data.branch;
                 branch.cond = make_op_koopa((koopa_raw_value_t)leftExp->build_koopa_values(), KOOPA_RBO_EQ);
-                koopa_raw_basic_block_data_t *true_block = new koopa_raw_basic_block_data_t();
-                koopa_raw_basic_block_data_t *end_block = new koopa_raw_basic_block_data_t();
+                koopa_raw_basic_block_data_t *true_block = new_koopa_raw_basic_block();
+                koopa_raw_basic_block_data_t *end_block = new_koopa_raw_basic_block();
                 branch.true_bb = true_block;
                 branch.false_bb = end_block;
                 branch.true_args = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
@@ -810,6 +900,17 @@ public:
         }
         return res;
     }
+    // a || b: a 为真直接跳到 true_bb, 否则进入 %lor_rhs 再判断 b
+    void build_koopa_branch(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) const override {
+        if (type == Primary) {
+            leftExp->build_koopa_branch(true_bb, false_bb);
+            return;
+        }
+        koopa_raw_basic_block_data_t *rhs_block = BasicBlock("%lor_rhs");
+        leftExp->build_koopa_branch(true_bb, rhs_block);
+        big_block.Push_back(rhs_block);
+        rightExp->build_koopa_branch(true_bb, false_bb);
+    }
     int CalcValue() const override {
         if (type == Primary)
             return leftExp->CalcValue();
@@ -5,7 +5,15 @@
 #include <memory>
 #include <string>
 #include "AST/AST.hpp"
+#include "opt/idiom.hpp"
+#include "opt/interchange.hpp"
+#include "opt/simplify.hpp"
+#include "opt/strength.hpp"
+#include "opt/unroll.hpp"
+#include "utils/const_init.hpp"
+#include "utils/koopa_interp.hpp"
 #include "utils/riscv_util.hpp"
+#include "utils/time_report.hpp"
 
 using namespace std;
 
@@ -19,11 +27,47 @@ extern int yyparse(std::unique_ptr<BaseAST> &ast);
 
 int main(int argc, const char *argv[]) {
     // 解析命令行参数. 测试脚本/评测平台要求你的编译器能接收如下参数:
-    // compiler 模式 输入文件 -o 输出文件
-    assert(argc == 5);
+    // compiler 模式 输入文件 -o 输出文件 [选项...]
+    assert(argc >= 5);
     auto mode = argv[1];
     auto input = argv[2];
     auto output = argv[4];
+    koopa2RISCV::Options backend_opts;
+    ProfileData profile;
+    // -O0 跳过 raw program 上的优化 (Simplifier 和循环优化), 给 -interp 算参考输出用
+    bool optimize = true;
+    for (int i = 5; i < argc; ++i) {
+        if (strcmp(argv[i], "-time-report") == 0)
+            TimeReport::Enable();
+        else if (strcmp(argv[i], "-mem-report") == 0)
+            MemReport::Enable();
+        else if (strcmp(argv[i], "-trace") == 0)
+            Trace::Enable(string(output) + ".trace.json", input);
+        else if (strncmp(argv[i], "-trace=", 7) == 0)
+            Trace::Enable(argv[i] + 7, input);
+        else if (strncmp(argv[i], "-march=", 7) == 0) {
+            const char *arch = argv[i] + 7;
+            backend_opts.zba = strstr(arch, "zba") != nullptr;
+            // rv32/rv64 后面的单字母扩展, 到第一个 '_' 为止
+            if (strncmp(arch, "rv32", 4) == 0 || strncmp(arch, "rv64", 4) == 0)
+                backend_opts.rvv = memchr(arch + 4, 'v', strcspn(arch + 4, "_")) != nullptr;
+        }
+        else if (strcmp(argv[i], "-O0") == 0)
+            optimize = false;
+        else if (strcmp(argv[i], "-instrument") == 0)
+            backend_opts.instrument = true;
+        else if (strncmp(argv[i], "-fprofile-use=", 14) == 0) {
+            if (!profile.Load(argv[i] + 14)) {
+                cout << "can not read profile: " << argv[i] + 14 << endl;
+                return 1;
+            }
+            backend_opts.profile = &profile;
+        }
+        else {
+            cout << "unknown option: " << argv[i] << endl;
+            return 1;
+        }
+    }
 
     // 打开输入文件, 并且指定 lexer 在解析的时候读取这个文件
     //std::cout << "mode: " << mode << std::endl;
@@ -32,7 +76,12 @@ int main(int argc, const char *argv[]) {
 
     // 调用 parser 函数, parser 函数会进一步调用 lexer 解析输入文件的
     unique_ptr<BaseAST> ast;
-    auto ret = yyparse(ast);
+    int ret;
+    TraceScope compile_span("compile", input);
+    {
+        PhaseScope phase("parse");
+        ret = yyparse(ast);
+    }
     if(ret) {
     cout << "yyparse error: " << ret << endl;
           assert(!ret);
@@ -41,25 +90,89 @@ int main(int argc, const char *argv[]) {
     // 输出解析得到的 AST, 其实就是个字符串，而且可以看到很多功能不完全。
     //cout << *ast << endl;
     unique_ptr<CompUnitAST> comp_ast(dynamic_cast<CompUnitAST *>(ast.release()));
-    koopa_raw_program_t krp = comp_ast->to_koopa_raw_program();
-    
+    koopa_raw_program_t krp;
+    BaseAST::runtime = strcmp(mode, "-riscv") == 0 || strcmp(mode, "-perf") == 0;
+    {
+        PhaseScope phase("ast to koopa raw");
+        krp = comp_ast->to_koopa_raw_program();
+    }
+    if (optimize) {
+        PhaseScope phase("simplify");
+        Simplifier().Run(&krp);
+    }
+    if (optimize) {
+        PhaseScope phase("loops");
+        LoopInterchanger interchanger;
+        interchanger.Run(&krp);
+        IdiomRecognizer idioms;
+        idioms.Run(&krp);
+        StrengthReducer reducer;
+        reducer.keep_vector_loops = backend_opts.rvv;
+        reducer.Run(&krp);
+        LoopUnroller unroller;
+        unroller.keep_vector_loops = backend_opts.rvv;
+        unroller.Run(&krp);
+        // 展开后的副本里 i 的值是已知的, 被替换的下标也不再使用
+        if (interchanger.interchanged + idioms.memsets + idioms.memcpys + reducer.reduced + unroller.full +
+            unroller.partial)
+            Simplifier().Run(&krp);
+    }
+
     if(strcmp(mode, "-koopa") == 0) {
         std::cout << "generate koopa file..." << std::endl;
+        // 文本形式的 IR 需要完整的初始化列表
+        ConstInit::MaterializeAll(&krp);
         koopa_program_t kp;
-        koopa_error_code_t eno = koopa_generate_raw_to_koopa(&krp, &kp);
+        koopa_error_code_t eno;
+        {
+            PhaseScope phase("koopa generate");
+            eno = koopa_generate_raw_to_koopa(&krp, &kp);
+        }
         if (eno != KOOPA_EC_SUCCESS) {
             std::cout << "generate raw to koopa error: " << (int)eno << std::endl;
             return 0;
         }
+        PhaseScope phase("koopa dump");
         koopa_dump_to_file(kp, output);
     }
+    else if(strcmp(mode, "-interp") == 0) {
+        // 直接解释执行 raw program: 程序的输入输出走 stdin/stdout, 动态计数写到输出文件
+        KoopaInterpreter interp(stdin, stdout);
+        int exit_code;
+        {
+            PhaseScope phase("interp");
+            exit_code = interp.run(&krp);
+        }
+        std::ofstream out(output);
+        interp.report(out);
+        return exit_code & 0xff;
+    }
     else if(strcmp(mode, "-riscv") == 0 || strcmp(mode, "-perf") == 0) {
         std::cout << "generate koopa file..." << std::endl;
         koopa_program_t kp;
-        koopa_error_code_t eno = koopa_generate_raw_to_koopa(&krp, &kp);
-        char *buffer = new char[1000000];
-        size_t sz = 1000000u;
-        eno = koopa_dump_to_string(kp, buffer, &sz);
+        koopa_error_code_t eno;
+        {
+            PhaseScope phase("koopa generate");
+            eno = koopa_generate_raw_to_koopa(&krp, &kp);
+        }
+        if (eno != KOOPA_EC_SUCCESS) {
+            std::cout << "generate raw to koopa error: " << (int)eno << std::endl;
+            return 0;
+        }
+        char *buffer = nullptr;
+        size_t sz = 0;
+        {
+            PhaseScope phase("koopa dump");
+            // 先询问需要的长度 (buffer 为空时 libkoopa 只写回长度), 大程序会超出固定大小的缓冲区.
+            // 再传入真正的容量, 结尾的 '\0' 自己补上
+            eno = koopa_dump_to_string(kp, nullptr, &sz);
+            if (eno == KOOPA_EC_SUCCESS) {
+                buffer = new char[sz + 1];
+                size_t cap = sz + 1;
+                eno = koopa_dump_to_string(kp, buffer, &cap);
+                buffer[sz] = '\0';
+            }
+        }
         if (eno != KOOPA_EC_SUCCESS) {
             std::cout << "koopa dump to string error: " << (int)eno << std::endl;
             return 0;
@@ -67,21 +180,32 @@ int main(int argc, const char *argv[]) {
         koopa_delete_program(kp);
 
         koopa_program_t new_kp;
-        eno = koopa_parse_from_string(buffer, &new_kp);
-        if (eno != KOOPA_EC_SUCCESS) {
-            std::cout << "generate raw to koopa error: " << (int)eno << std::endl;
-            return 0;
+        koopa_raw_program_builder_t kp_builder;
+        koopa_raw_program_t new_krp;
+        {
+            PhaseScope phase("koopa reparse");
+            eno = koopa_parse_from_string(buffer, &new_kp);
+            if (eno != KOOPA_EC_SUCCESS) {
+                std::cout << "generate raw to koopa error: " << (int)eno << std::endl;
+                return 0;
+            }
+            kp_builder = koopa_new_raw_program_builder();
+            new_krp = koopa_build_raw_program(kp_builder, new_kp);
+            koopa_delete_program(new_kp);
         }
-        koopa_raw_program_builder_t kp_builder = koopa_new_raw_program_builder();
-        koopa_raw_program_t new_krp = koopa_build_raw_program(kp_builder, new_kp);
-        koopa_delete_program(new_kp);
 
         std::cout << "generate riscv file..." << std::endl;
         std::ofstream out(output);
-        //RISCVBuilder builder(std::cout);
-        RISCVBuilder builder(out);
-        builder.build(&new_krp);
-        out.close();
+        //koopa2RISCV builder(std::cout);
+        koopa2RISCV builder(out, backend_opts);
+        {
+            PhaseScope phase("riscv");
+            builder.build(&new_krp);
+        }
+        {
+            PhaseScope phase("write output");
+            out.close();
+        }
         koopa_delete_raw_program_builder(kp_builder);
     }
     
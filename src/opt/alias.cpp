@@ -0,0 +1,99 @@
+#include "opt/alias.hpp"
+
+#include <cstdlib>
+
+#include "opt/ir_util.hpp"
+
+AliasAnalysis::AliasAnalysis(koopa_raw_function_t kfunc) {
+    // 数组参数的槽: 只在入口处存入参数的 alloc *T
+    std::set<koopa_raw_value_t> stored;
+    for (uint32_t b = 0; b < kfunc->bbs.len; ++b) {
+        koopa_raw_basic_block_t kblk = (koopa_raw_basic_block_t)kfunc->bbs.buffer[b];
+        for (uint32_t j = 0; j < kblk->insts.len; ++j) {
+            koopa_raw_value_t kval = (koopa_raw_value_t)kblk->insts.buffer[j];
+            if (kval->kind.tag != KOOPA_RVT_STORE)
+                continue;
+            koopa_raw_value_t dest = kval->kind.data.store.dest;
+            if (kval->kind.data.store.value->kind.tag == KOOPA_RVT_FUNC_ARG_REF && !stored.count(dest))
+                params.insert(dest);
+            else
+                params.erase(dest);
+            stored.insert(dest);
+        }
+    }
+    for (auto it = params.begin(); it != params.end();) {
+        koopa_raw_value_t slot = *it;
+        if (slot->kind.tag == KOOPA_RVT_ALLOC && slot->ty->data.pointer.base->tag == KOOPA_RTT_POINTER)
+            ++it;
+        else
+            it = params.erase(it);
+    }
+}
+
+bool AliasAnalysis::IsParam(koopa_raw_value_t slot) const {
+    return params.count(slot) != 0;
+}
+
+AliasAnalysis::Location AliasAnalysis::Locate(koopa_raw_value_t ptr) const {
+    Location res;
+    res.known = true;
+    for (;;) {
+        koopa_raw_value_t src, index;
+        int64_t stride;
+        switch (ptr->kind.tag) {
+        case KOOPA_RVT_GET_ELEM_PTR:
+            src = ptr->kind.data.get_elem_ptr.src;
+            index = ptr->kind.data.get_elem_ptr.index;
+            stride = type_ints(src->ty->data.pointer.base->data.array.base);
+            break;
+        case KOOPA_RVT_GET_PTR:
+            src = ptr->kind.data.get_ptr.src;
+            index = ptr->kind.data.get_ptr.index;
+            stride = type_ints(src->ty->data.pointer.base);
+            break;
+        case KOOPA_RVT_ALLOC:
+        case KOOPA_RVT_GLOBAL_ALLOC:
+            res.root = ptr;
+            return res;
+        case KOOPA_RVT_LOAD:
+            if (!IsParam(ptr->kind.data.load.src))
+                return Location();
+            res.root = ptr->kind.data.load.src;
+            res.param = true;
+            return res;
+        default:
+            return Location();
+        }
+        if (res.known && is_const(index)) {
+            res.offset += const_value(index) * stride;
+            res.known = std::llabs(res.offset) <= INT32_MAX;
+        }
+        else
+            res.known = false;
+        ptr = src;
+    }
+}
+
+AliasAnalysis::Result AliasAnalysis::Alias(const Location &x, int64_t x_size, const Location &y, int64_t y_size) const {
+    if (!x.root || !y.root)
+        return MAY_ALIAS;
+    if (x.param || y.param) {
+        // 参数指向全局变量或调用者的数组
+        const Location &other = x.param ? y : x;
+        if (!other.param && other.root->kind.tag != KOOPA_RVT_GLOBAL_ALLOC)
+            return NO_ALIAS;
+    }
+    else if (x.root != y.root)
+        return NO_ALIAS;
+    if (x.root != y.root || x.param != y.param || !x.known || !y.known)
+        return MAY_ALIAS;
+    if (x.offset + x_size <= y.offset || y.offset + y_size <= x.offset)
+        return NO_ALIAS;
+    return x.offset == y.offset && x_size == y_size ? MUST_ALIAS : MAY_ALIAS;
+}
+
+AliasAnalysis::Result AliasAnalysis::Alias(koopa_raw_value_t p, koopa_raw_value_t q) const {
+    if (p == q)
+        return MUST_ALIAS;
+    return Alias(Locate(p), type_ints(p->ty->data.pointer.base), Locate(q), type_ints(q->ty->data.pointer.base));
+}
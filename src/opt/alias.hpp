@@ -0,0 +1,55 @@
+#ifndef ALIAS_H
+#define ALIAS_H
+
+#include <cstdint>
+#include <set>
+
+#include <koopa.h>
+
+// Alias analysis over the pointers of one function of the raw program, for the passes which
+// move, remove or reorder loads and stores.
+//
+// A pointer is traced back through getelemptr/getptr to the object it points into:
+//
+//     ALLOC         a local variable or array of the function
+//     GLOBAL_ALLOC  a global variable or array
+//     parameter     the array an array parameter points to, loaded from its `alloc *T`
+//                   slot; the slot is only stored the argument, at the entry
+//
+// Different locals and globals are different memory. A parameter points into a global or
+// an array of a caller, so it may alias the globals and the other parameters, never a local
+// of the function (not even its own slot). Pointers loaded from anything else, like the
+// `@sr_ptr` variables of `StrengthReducer`, are unknown and may alias everything.
+//
+// Within one object, an access made of constant indices has a known offset, in ints with
+// the strides of the types, so `a[1][2]` and `a[1][3]` do not alias and `a[1]` (a row)
+// and `a[1][3]` do.
+class AliasAnalysis {
+public:
+    enum Result { NO_ALIAS, MAY_ALIAS, MUST_ALIAS };
+
+    // The object a pointer points into, nullptr if unknown; for a parameter `root` is its
+    // slot and `param` is set. `offset` from the start of the object, in ints, if `known`.
+    struct Location {
+        koopa_raw_value_t root = nullptr;
+        bool param = false;
+        bool known = false;
+        int64_t offset = 0;
+    };
+
+private:
+    // Slots of the array parameters.
+    std::set<koopa_raw_value_t> params;
+
+public:
+    explicit AliasAnalysis(koopa_raw_function_t kfunc);
+
+    // Whether `slot` is the slot of an array parameter.
+    bool IsParam(koopa_raw_value_t slot) const;
+    Location Locate(koopa_raw_value_t ptr) const;
+    // Whether accesses of `x_size` ints at `x` and `y_size` ints at `y` overlap.
+    Result Alias(const Location &x, int64_t x_size, const Location &y, int64_t y_size) const;
+    // Whether loads or stores through the pointers `p` and `q` overlap.
+    Result Alias(koopa_raw_value_t p, koopa_raw_value_t q) const;
+};
+#endif
@@ -0,0 +1,110 @@
+#include "opt/idiom.hpp"
+
+#include <cstring>
+#include <vector>
+
+#include "opt/unroll.hpp"
+#include "utils/koopa_util.hpp"
+
+bool IdiomRecognizer::replace(koopa_raw_function_data_t *kfunc, const VectorLoop &vl) {
+    const CountedLoop &loop = vl.loop;
+    if (vl.sum || !vl.overlap.empty())
+        return false;
+    koopa_raw_value_t store = nullptr;
+    size_t vectors = 0;
+    for (const auto &p : vl.kind) {
+        if (p.second == VectorLoop::STORE) {
+            if (store)
+                return false;
+            store = p.first;
+        }
+        else if (p.second == VectorLoop::VECTOR)
+            ++vectors;
+    }
+    if (!store)
+        return false;
+    koopa_raw_value_t value = store->kind.data.store.value, dest = store->kind.data.store.dest;
+    auto kind = vl.kind.find(value);
+    auto coef = vl.coef.find(value);
+    koopa_raw_function_t callee;
+    koopa_raw_value_t src;
+    if (kind == vl.kind.end() || kind->second == VectorLoop::SCALAR) {
+        // 填充: 值在每一轮都一样
+        if (vectors != 0 || (coef != vl.coef.end() && coef->second != 0))
+            return false;
+        callee = memset_func;
+        src = value;
+    }
+    else {
+        // 复制: 唯一的 VECTOR 是从另一个地址 load 出来的值
+        if (vectors != 1 || value->kind.tag != KOOPA_RVT_LOAD || value->kind.data.load.src == dest)
+            return false;
+        callee = memcpy_func;
+        src = value->kind.data.load.src;
+    }
+    if (!callee)
+        return false;
+
+    koopa_raw_basic_block_data_t *body = (koopa_raw_basic_block_data_t *)vl.body;
+    std::vector<const void *> insts;
+    for (uint32_t j = 0; j < body->insts.len; ++j) {
+        koopa_raw_value_t kval = (koopa_raw_value_t)body->insts.buffer[j];
+        auto it = vl.kind.find(kval);
+        if (it->second == VectorLoop::SCALAR || it->second == VectorLoop::ADDRESS)
+            insts.push_back(kval);
+    }
+    koopa_raw_value_data *i = LoadInst(loop.iv);
+    insts.push_back(i);
+    koopa_raw_value_t n = loop.bound;
+    if (loop.bound_var) {
+        koopa_raw_value_data *load = LoadInst(loop.bound_var);
+        insts.push_back(load);
+        n = load;
+    }
+    koopa_raw_value_data *count = BinaryInst(KOOPA_RBO_SUB, n, i);
+    insts.push_back(count);
+    koopa_raw_value_t end = n;
+    if (loop.op == KOOPA_RBO_LE) {
+        koopa_raw_value_data *count1 = BinaryInst(KOOPA_RBO_ADD, count, make_koopa_interger(1));
+        koopa_raw_value_data *end1 = BinaryInst(KOOPA_RBO_ADD, n, make_koopa_interger(1));
+        insts.push_back(count1);
+        insts.push_back(end1);
+        count = count1;
+        end = end1;
+    }
+    insts.push_back(CallInst(callee, {dest, src, count}));
+    insts.push_back(StoreInst(end, loop.iv));
+    insts.push_back(JumpInst(loop.exit));
+    body->insts = make_koopa_raw_slice(insts, KOOPA_RSIK_VALUE);
+
+    // 只有循环体跳到 latch, 删掉它
+    std::vector<const void *> bbs;
+    for (uint32_t b = 0; b < kfunc->bbs.len; ++b)
+        if (b != loop.latch)
+            bbs.push_back(kfunc->bbs.buffer[b]);
+    kfunc->bbs = make_koopa_raw_slice(bbs, KOOPA_RSIK_BASIC_BLOCK);
+    ++(callee == memset_func ? memsets : memcpys);
+    return true;
+}
+
+void IdiomRecognizer::Run(const koopa_raw_program_t *raw) {
+    for (uint32_t i = 0; i < raw->funcs.len; ++i) {
+        koopa_raw_function_t kfunc = (koopa_raw_function_t)raw->funcs.buffer[i];
+        if (strcmp(kfunc->name, "@__sysy_memset32") == 0)
+            memset_func = kfunc;
+        else if (strcmp(kfunc->name, "@__sysy_memcpy32") == 0)
+            memcpy_func = kfunc;
+    }
+    for (uint32_t i = 0; i < raw->funcs.len; ++i) {
+        koopa_raw_function_data_t *kfunc = (koopa_raw_function_data_t *)raw->funcs.buffer[i];
+        if (kfunc->bbs.len == 0)
+            continue;
+        // 从后往前处理, 删掉 latch 不影响前面循环的下标
+        std::vector<CountedLoop> loops = FindCountedLoops(kfunc);
+        for (auto it = loops.rbegin(); it != loops.rend(); ++it) {
+            VectorLoop vl;
+            if (!LoopUnroller::FullyUnrolls(*it) && MatchVectorLoop(kfunc, *it, vl))
+                replace(kfunc, vl);
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef IDIOM_H
+#define IDIOM_H
+
+#include <cstddef>
+
+#include <koopa.h>
+
+#include "opt/vectorize.hpp"
+
+// Counted loops (see `CountedLoop`) which fill or copy an int array, replaced by a call to
+// the compiler's runtime (`@__sysy_memset32`, `@__sysy_memcpy32`, see `add_lib_funcs`):
+//
+//     while (i < n) { a[i + c] = v; i = i + 1; }          v the same in every iteration
+//     while (i < n) { a[i + c] = b[i + d]; i = i + 1; }   a and b do not overlap
+//
+// The body keeps the computation of the addresses, which is done once for the first i, then
+//
+//     body:  ...; call @__sysy_memset32(%p, v, n - i); store n, @i; jump exit
+//
+// (n - i + 1 and n + 1 for `<=`), and the latch is removed, so the loop is gone. The loops
+// are found with `MatchVectorLoop`: a single STORE of a SCALAR value, or of a VECTOR load
+// from a different ADDRESS, with no sum and nothing to check at run time.
+//
+// Loops `LoopUnroller` fully unrolls are left alone, their stores are cheaper than a call.
+// The routines are only declared for `-riscv`/`-perf` (`BaseAST::runtime`), whose backend
+// emits them; without them nothing is replaced.
+class IdiomRecognizer {
+    koopa_raw_function_t memset_func = nullptr, memcpy_func = nullptr;
+
+    bool replace(koopa_raw_function_data_t *kfunc, const VectorLoop &vl);
+
+public:
+    // Loops replaced by `@__sysy_memset32` and `@__sysy_memcpy32`, over all runs.
+    size_t memsets = 0, memcpys = 0;
+
+    void Run(const koopa_raw_program_t *raw);
+};
+#endif
@@ -0,0 +1,518 @@
+#include "opt/interchange.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+
+#include "opt/ir_util.hpp"
+#include "utils/koopa_util.hpp"
+
+static koopa_raw_value_t terminator(koopa_raw_basic_block_t kblk) {
+    return kblk->insts.len ? (koopa_raw_value_t)kblk->insts.buffer[kblk->insts.len - 1] : nullptr;
+}
+
+//
+// Length of the last dimension of the array at `root`, 0 for a plain `int *` parameter.
+//
+static int64_t row_length(koopa_raw_value_t root, bool param) {
+    koopa_raw_type_t ty = root->ty->data.pointer.base;
+    if (param)
+        ty = ty->data.pointer.base;
+    if (ty->tag != KOOPA_RTT_ARRAY)
+        return 0;
+    while (ty->data.array.base->tag == KOOPA_RTT_ARRAY)
+        ty = ty->data.array.base;
+    return ty->data.array.len;
+}
+
+static bool same_value(koopa_raw_value_t x, koopa_raw_value_t y) {
+    if (x == y)
+        return true;
+    if (!x || !y || x->kind.tag != y->kind.tag)
+        return false;
+    switch (x->kind.tag) {
+    case KOOPA_RVT_INTEGER:
+        return const_value(x) == const_value(y);
+    case KOOPA_RVT_LOAD:
+        return x->kind.data.load.src == y->kind.data.load.src;
+    case KOOPA_RVT_BINARY:
+        return x->kind.data.binary.op == y->kind.data.binary.op &&
+               same_value(x->kind.data.binary.lhs, y->kind.data.binary.lhs) &&
+               same_value(x->kind.data.binary.rhs, y->kind.data.binary.rhs);
+    default:
+        return false;
+    }
+}
+//
+// Whether `var` may be read after entering `kblk`, before it is stored to.
+//
+static bool live_at(koopa_raw_basic_block_t kblk, koopa_raw_value_t var) {
+    std::set<koopa_raw_basic_block_t> seen;
+    std::vector<koopa_raw_basic_block_t> work{kblk};
+    while (!work.empty()) {
+        kblk = work.back();
+        work.pop_back();
+        if (!seen.insert(kblk).second)
+            continue;
+        bool killed = false;
+        for (uint32_t j = 0; j < kblk->insts.len && !killed; ++j) {
+            koopa_raw_value_t kval = (koopa_raw_value_t)kblk->insts.buffer[j];
+            if (kval->kind.tag == KOOPA_RVT_LOAD && kval->kind.data.load.src == var)
+                return true;
+            killed = kval->kind.tag == KOOPA_RVT_STORE && kval->kind.data.store.dest == var;
+        }
+        koopa_raw_value_t term = terminator(kblk);
+        if (killed || !term)
+            continue;
+        if (term->kind.tag == KOOPA_RVT_BRANCH) {
+            work.push_back(term->kind.data.branch.true_bb);
+            work.push_back(term->kind.data.branch.false_bb);
+        }
+        else if (term->kind.tag == KOOPA_RVT_JUMP)
+            work.push_back(term->kind.data.jump.target);
+    }
+    return false;
+}
+//
+// `load @i; (load @n;) lt/le` of the test of `loop`, appended to `insts`.
+//
+static koopa_raw_value_t emit_test(std::vector<const void *> &insts, const CountedLoop &loop) {
+    koopa_raw_value_data *i = LoadInst(loop.iv);
+    insts.push_back(i);
+    koopa_raw_value_t n = loop.bound;
+    if (loop.bound_var) {
+        koopa_raw_value_data *load = LoadInst(loop.bound_var);
+        insts.push_back(load);
+        n = load;
+    }
+    koopa_raw_value_data *cmp = BinaryInst(loop.op, i, n);
+    insts.push_back(cmp);
+    return cmp;
+}
+
+static void emit_increment(std::vector<const void *> &insts, const CountedLoop &loop) {
+    koopa_raw_value_data *i = LoadInst(loop.iv);
+    koopa_raw_value_data *add = BinaryInst(KOOPA_RBO_ADD, i, make_koopa_interger(loop.step));
+    insts.push_back(i);
+    insts.push_back(add);
+    insts.push_back(StoreInst(add, loop.iv));
+}
+//
+// Find the loop around `inner` of which it is the whole body, fill in `outer`.
+//
+bool LoopInterchanger::match_nest(koopa_raw_function_t kfunc) {
+    koopa_raw_basic_block_t *bbs = (koopa_raw_basic_block_t *)kfunc->bbs.buffer;
+    size_t len = kfunc->bbs.len;
+    size_t end = inner.latch + 1;
+    if (!inner.has_init || inner.pre + 1 != inner.head || end + 1 >= len || bbs[end] != inner.exit)
+        return false;
+    koopa_raw_basic_block_t head = bbs[inner.pre], eblk = bbs[end], latch = bbs[end + 1];
+
+    // end: %x = load @i; %y = add %x, s; store %y, @i; jump latch
+    if (eblk->insts.len != 4)
+        return false;
+    koopa_raw_value_t x = (koopa_raw_value_t)eblk->insts.buffer[0], y = (koopa_raw_value_t)eblk->insts.buffer[1];
+    koopa_raw_value_t st = (koopa_raw_value_t)eblk->insts.buffer[2], jump = (koopa_raw_value_t)eblk->insts.buffer[3];
+    if (x->kind.tag != KOOPA_RVT_LOAD || y->kind.tag != KOOPA_RVT_BINARY || y->kind.data.binary.op != KOOPA_RBO_ADD ||
+        y->kind.data.binary.lhs != x || !is_const(y->kind.data.binary.rhs) || st->kind.tag != KOOPA_RVT_STORE ||
+        st->kind.data.store.value != y || st->kind.data.store.dest != x->kind.data.load.src ||
+        jump->kind.tag != KOOPA_RVT_JUMP || jump->kind.data.jump.target != latch)
+        return false;
+    if (!MatchLatch(latch, outer) || outer.iv != x->kind.data.load.src || outer.iv == inner.iv ||
+        terminator(latch)->kind.data.branch.true_bb != head)
+        return false;
+    outer.step = const_value(y->kind.data.binary.rhs);
+    if (outer.step <= 0 || outer.step > 1024 || inner.bound_var == outer.iv || outer.bound_var == inner.iv)
+        return false;
+    outer.head = inner.pre;
+    outer.incr = end;
+    outer.latch = end + 1;
+
+    // head: only allocs and the start and test of the inner loop
+    for (uint32_t j = 0; j + 1 < head->insts.len; ++j) {
+        koopa_raw_value_t kval = (koopa_raw_value_t)head->insts.buffer[j];
+        switch (kval->kind.tag) {
+        case KOOPA_RVT_ALLOC:
+        case KOOPA_RVT_LOAD:
+        case KOOPA_RVT_BINARY:
+            break;
+        case KOOPA_RVT_STORE:
+            if (kval->kind.data.store.dest == inner.iv)
+                break;
+            return false;
+        default:
+            return false;
+        }
+    }
+
+    // head 只从 pre 和 latch 进入, end 只从 head 和内层的 latch, latch 只从 end
+    outer.pre = len;
+    for (size_t b = 0; b < len; ++b) {
+        koopa_raw_value_t term = terminator(bbs[b]);
+        if (!term)
+            continue;
+        std::vector<koopa_raw_basic_block_t> targets;
+        if (term->kind.tag == KOOPA_RVT_BRANCH)
+            targets = {term->kind.data.branch.true_bb, term->kind.data.branch.false_bb};
+        else if (term->kind.tag == KOOPA_RVT_JUMP)
+            targets = {term->kind.data.jump.target};
+        for (koopa_raw_basic_block_t t : targets) {
+            if (t == head && b != end + 1) {
+                if (outer.pre != len || term->kind.tag != KOOPA_RVT_BRANCH ||
+                    term->kind.data.branch.false_bb != outer.exit || (b >= inner.pre && b <= end + 1))
+                    return false;
+                outer.pre = b;
+            }
+            else if (t == eblk && b != inner.pre && b != inner.latch)
+                return false;
+            else if (t == latch && b != end)
+                return false;
+        }
+    }
+    if (outer.pre == len)
+        return false;
+    size_t exit_pos = std::find(bbs, bbs + len, outer.exit) - bbs;
+    if (exit_pos >= inner.pre && exit_pos <= end + 1)
+        return false;
+
+    // pre 中最后一次对 @i 的赋值
+    outer_init = nullptr;
+    koopa_raw_basic_block_t pre = bbs[outer.pre];
+    for (uint32_t j = pre->insts.len; j-- > 0 && !outer_init; ) {
+        koopa_raw_value_t kval = (koopa_raw_value_t)pre->insts.buffer[j];
+        if (kval->kind.tag == KOOPA_RVT_STORE && kval->kind.data.store.dest == outer.iv)
+            outer_init = kval->kind.data.store.value;
+    }
+    if (!outer_init)
+        return false;
+    outer.has_init = is_const(outer_init);
+    if (outer.has_init)
+        outer.init = const_value(outer_init);
+    return !live_at(outer.exit, outer.iv) && !live_at(outer.exit, inner.iv);
+}
+//
+// Whether `kval` has the same value in the whole nest.
+//
+bool LoopInterchanger::invariant(koopa_raw_value_t kval) {
+    if (!defined.count(kval))
+        return true;
+    const koopa_raw_value_kind_t &kind = kval->kind;
+    switch (kind.tag) {
+    case KOOPA_RVT_LOAD: {
+        koopa_raw_value_t src = kind.data.load.src;
+        return (src->kind.tag == KOOPA_RVT_ALLOC || src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) &&
+               src->ty->data.pointer.base->tag != KOOPA_RTT_ARRAY && !stored.count(src);
+    }
+    case KOOPA_RVT_GET_PTR:
+        return invariant(kind.data.get_ptr.src) && invariant(kind.data.get_ptr.index);
+    case KOOPA_RVT_GET_ELEM_PTR:
+        return invariant(kind.data.get_elem_ptr.src) && invariant(kind.data.get_elem_ptr.index);
+    case KOOPA_RVT_BINARY:
+        return invariant(kind.data.binary.lhs) && invariant(kind.data.binary.rhs);
+    default:
+        return false;
+    }
+}
+
+bool LoopInterchanger::affine(koopa_raw_value_t kval, Affine &res) {
+    if (is_const(kval)) {
+        res.c = const_value(kval);
+        return true;
+    }
+    if (kval->kind.tag == KOOPA_RVT_LOAD && kval->kind.data.load.src == outer.iv) {
+        res.a = 1;
+        return true;
+    }
+    if (kval->kind.tag == KOOPA_RVT_LOAD && kval->kind.data.load.src == inner.iv) {
+        // 自增之后的 load @j 是下一轮的 j
+        if (after_incr.count(kval))
+            return false;
+        res.b = 1;
+        return true;
+    }
+    if (invariant(kval)) {
+        res.rest = kval;
+        return true;
+    }
+    if (kval->kind.tag != KOOPA_RVT_BINARY)
+        return false;
+    Affine lhs, rhs;
+    if (!affine(kval->kind.data.binary.lhs, lhs) || !affine(kval->kind.data.binary.rhs, rhs))
+        return false;
+    switch (kval->kind.data.binary.op) {
+    case KOOPA_RBO_ADD:
+    case KOOPA_RBO_SUB: {
+        int64_t sign = kval->kind.data.binary.op == KOOPA_RBO_ADD ? 1 : -1;
+        if (rhs.rest && (lhs.rest || sign < 0))
+            return false;
+        res.a = lhs.a + sign * rhs.a;
+        res.b = lhs.b + sign * rhs.b;
+        res.c = lhs.c + sign * rhs.c;
+        res.rest = lhs.rest ? lhs.rest : rhs.rest;
+        break;
+    }
+    case KOOPA_RBO_MUL:
+        if (lhs.a == 0 && lhs.b == 0 && !lhs.rest)
+            std::swap(lhs, rhs);
+        if (rhs.a != 0 || rhs.b != 0 || rhs.rest || lhs.rest)
+            return false;
+        res.a = lhs.a * rhs.c;
+        res.b = lhs.b * rhs.c;
+        res.c = lhs.c * rhs.c;
+        break;
+    default:
+        return false;
+    }
+    return std::llabs(res.a) <= INT32_MAX && std::llabs(res.b) <= INT32_MAX && std::llabs(res.c) <= INT32_MAX;
+}
+//
+// The object and offset addressed by the pointer `kval`.
+//
+bool LoopInterchanger::address(koopa_raw_value_t kval, Access &res) {
+    koopa_raw_value_t src, index;
+    int64_t stride;
+    switch (kval->kind.tag) {
+    case KOOPA_RVT_ALLOC:
+    case KOOPA_RVT_GLOBAL_ALLOC:
+        res.root = kval;
+        res.param = false;
+        res.offset = Affine();
+        return true;
+    case KOOPA_RVT_LOAD:
+        // 数组参数
+        src = kval->kind.data.load.src;
+        if (!alias->IsParam(src) || stored.count(src))
+            return false;
+        res.root = src;
+        res.param = true;
+        res.offset = Affine();
+        return true;
+    case KOOPA_RVT_GET_ELEM_PTR:
+        src = kval->kind.data.get_elem_ptr.src;
+        index = kval->kind.data.get_elem_ptr.index;
+        stride = type_ints(src->ty->data.pointer.base->data.array.base);
+        break;
+    case KOOPA_RVT_GET_PTR:
+        src = kval->kind.data.get_ptr.src;
+        index = kval->kind.data.get_ptr.index;
+        stride = type_ints(src->ty->data.pointer.base);
+        break;
+    default:
+        return false;
+    }
+    Affine idx;
+    if (!address(src, res) || !affine(index, idx))
+        return false;
+    Affine &off = res.offset;
+    if (idx.rest && (off.rest || stride != 1))
+        return false;
+    off.a += idx.a * stride;
+    off.b += idx.b * stride;
+    off.c += idx.c * stride;
+    if (idx.rest)
+        off.rest = idx.rest;
+    return std::llabs(off.a) <= INT32_MAX && std::llabs(off.b) <= INT32_MAX && std::llabs(off.c) <= INT32_MAX;
+}
+//
+// Collect the accesses of the body of `inner`, false if it has anything else with side effects.
+//
+bool LoopInterchanger::collect(koopa_raw_function_t kfunc) {
+    koopa_raw_basic_block_t *bbs = (koopa_raw_basic_block_t *)kfunc->bbs.buffer;
+    defined.clear();
+    stored.clear();
+    after_incr.clear();
+    accesses.clear();
+    koopa_raw_value_t incr = nullptr;
+    for (size_t b = inner.pre; b <= outer.latch; ++b)
+        for (uint32_t j = 0; j < bbs[b]->insts.len; ++j) {
+            koopa_raw_value_t kval = (koopa_raw_value_t)bbs[b]->insts.buffer[j];
+            if (b >= inner.head && b < inner.latch)
+                defined.insert(kval);
+            if (kval->kind.tag == KOOPA_RVT_STORE) {
+                stored.insert(kval->kind.data.store.dest);
+                if (b == inner.incr && kval->kind.data.store.dest == inner.iv)
+                    incr = kval;
+            }
+            if (incr && b == inner.incr && kval != incr)
+                after_incr.insert(kval);
+        }
+
+    for (size_t b = inner.head; b < inner.latch; ++b)
+        for (uint32_t j = 0; j < bbs[b]->insts.len; ++j) {
+            koopa_raw_value_t kval = (koopa_raw_value_t)bbs[b]->insts.buffer[j];
+            Access access;
+            switch (kval->kind.tag) {
+            case KOOPA_RVT_LOAD: {
+                koopa_raw_value_t src = kval->kind.data.load.src;
+                if (src->kind.tag == KOOPA_RVT_ALLOC || src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
+                    break;
+                if (!address(src, access))
+                    return false;
+                access.store = false;
+                accesses.push_back(access);
+                break;
+            }
+            case KOOPA_RVT_STORE: {
+                koopa_raw_value_t dest = kval->kind.data.store.dest;
+                if (kval == incr)
+                    break;
+                if (dest->kind.tag == KOOPA_RVT_ALLOC || dest->kind.tag == KOOPA_RVT_GLOBAL_ALLOC || !address(dest, access))
+                    return false;
+                access.store = true;
+                accesses.push_back(access);
+                break;
+            }
+            case KOOPA_RVT_BRANCH:
+                // break
+                if (kval->kind.data.branch.true_bb == inner.exit || kval->kind.data.branch.false_bb == inner.exit)
+                    return false;
+                break;
+            case KOOPA_RVT_JUMP:
+                if (kval->kind.data.jump.target == inner.exit)
+                    return false;
+                break;
+            case KOOPA_RVT_CALL:
+            case KOOPA_RVT_RETURN:
+                return false;
+            default:
+                break;
+            }
+        }
+    return true;
+}
+//
+// Whether iterations (i1, j1) and (i2, j2) with i1 < i2 and j1 > j2 may access one element
+// through `x` and `y`.
+//
+bool LoopInterchanger::crosses(const Access &x, const Access &y) {
+    if (x.root != y.root || x.param != y.param) {
+        AliasAnalysis::Location lx, ly;
+        lx.root = x.root;
+        lx.param = x.param;
+        ly.root = y.root;
+        ly.param = y.param;
+        return alias->Alias(lx, 1, ly, 1) != AliasAnalysis::NO_ALIAS;
+    }
+    const Affine &f = x.offset, &g = y.offset;
+    if (f.a != g.a || f.b != g.b || !same_value(f.rest, g.rest))
+        return true;
+    // a * s * t + b * s' * u = d, t 和 u 是两次迭代相差的轮数, 符号相反时交换后顺序颠倒
+    int64_t d = g.c - f.c, a = f.a * outer.step, b = f.b * inner.step;
+    int64_t ti = outer.TripCount(), tj = inner.TripCount();
+    if (ti >= 0 && tj >= 0 && ti <= 4096) {
+        for (int64_t t = 1 - ti; t < ti; ++t) {
+            if (t == 0)
+                continue;
+            int64_t rem = d - a * t;
+            if (b == 0) {
+                if (rem == 0 && tj >= 2)
+                    return true;
+                continue;
+            }
+            if (rem % b != 0)
+                continue;
+            int64_t u = rem / b;
+            if (u != 0 && (u > 0) != (t > 0) && std::llabs(u) < tj)
+                return true;
+        }
+        return false;
+    }
+    if (a == 0 && b == 0)
+        return d == 0;
+    if (b == 0)
+        return d != 0 && d % a == 0;
+    if (a == 0)
+        return d != 0 && d % b == 0;
+    // 同一行: i 只换行, j 只在最后一维里移动
+    int64_t row = row_length(x.root, x.param);
+    return !(row > 0 && d == 0 && f.a % row == 0 && std::llabs(f.b) < row);
+}
+
+bool LoopInterchanger::legal_and_profitable(koopa_raw_function_t kfunc) {
+    if (!collect(kfunc) || accesses.empty())
+        return false;
+    for (size_t x = 0; x < accesses.size(); ++x)
+        for (size_t y = x; y < accesses.size(); ++y)
+            if ((accesses[x].store || accesses[y].store) && crosses(accesses[x], accesses[y]))
+                return false;
+    int64_t outer_stride = 0, inner_stride = 0;
+    for (const Access &access : accesses) {
+        outer_stride += std::min<int64_t>(std::llabs(access.offset.a), 16);
+        inner_stride += std::min<int64_t>(std::llabs(access.offset.b), 16);
+    }
+    return inner_stride > outer_stride;
+}
+//
+// Rewrite the control of the nest so `inner.iv` runs outside and `outer.iv` inside.
+//
+void LoopInterchanger::interchange(koopa_raw_function_t kfunc) {
+    koopa_raw_basic_block_data_t **bbs = (koopa_raw_basic_block_data_t **)kfunc->bbs.buffer;
+    koopa_raw_basic_block_data_t *pre = bbs[outer.pre], *head = bbs[inner.pre], *ihead = bbs[inner.head];
+    koopa_raw_basic_block_data_t *incr = bbs[inner.incr], *ilatch = bbs[inner.latch];
+    koopa_raw_basic_block_data_t *eblk = bbs[outer.incr], *latch = bbs[outer.latch];
+    std::vector<const void *> insts;
+
+    // pre: j = c; br j < m, head, exit. head 中的 alloc 移到这里, 使它们在 store 之前
+    for (uint32_t j = 0; j + 1 < head->insts.len; ++j)
+        if (((koopa_raw_value_t)head->insts.buffer[j])->kind.tag == KOOPA_RVT_ALLOC)
+            insts.push_back(head->insts.buffer[j]);
+    insts.insert(insts.end(), pre->insts.buffer, pre->insts.buffer + pre->insts.len - 1);
+    insts.push_back(StoreInst(make_koopa_interger(inner.init), inner.iv));
+    koopa_raw_value_t cmp = emit_test(insts, inner);
+    insts.push_back(BranchInst(cmp, head, outer.exit));
+    pre->insts = make_koopa_raw_slice(insts, KOOPA_RSIK_VALUE);
+
+    // head: i = v; br i < n, ihead, end
+    insts.clear();
+    insts.push_back(StoreInst(outer_init, outer.iv));
+    cmp = emit_test(insts, outer);
+    insts.push_back(BranchInst(cmp, ihead, eblk));
+    head->insts = make_koopa_raw_slice(insts, KOOPA_RSIK_VALUE);
+
+    // incr: 去掉 j 的自增, i 的自增放在跳转之前, 原来在 j 自增之后读 @i 的也还是这一轮的 i
+    insts.clear();
+    for (uint32_t j = 0; j < incr->insts.len; ++j) {
+        koopa_raw_value_t kval = (koopa_raw_value_t)incr->insts.buffer[j];
+        if (j + 1 == incr->insts.len)
+            emit_increment(insts, outer);
+        if (kval->kind.tag != KOOPA_RVT_STORE || kval->kind.data.store.dest != inner.iv)
+            insts.push_back(kval);
+    }
+    incr->insts = make_koopa_raw_slice(insts, KOOPA_RSIK_VALUE);
+
+    // inner latch: br i < n, ihead, end
+    insts.clear();
+    cmp = emit_test(insts, outer);
+    insts.push_back(BranchInst(cmp, ihead, eblk));
+    ilatch->insts = make_koopa_raw_slice(insts, KOOPA_RSIK_VALUE);
+
+    // end: j = j + s'; jump latch
+    insts.clear();
+    emit_increment(insts, inner);
+    insts.push_back(JumpInst(latch));
+    eblk->insts = make_koopa_raw_slice(insts, KOOPA_RSIK_VALUE);
+
+    // latch: br j < m, head, exit
+    insts.clear();
+    cmp = emit_test(insts, inner);
+    insts.push_back(BranchInst(cmp, head, outer.exit));
+    latch->insts = make_koopa_raw_slice(insts, KOOPA_RSIK_VALUE);
+}
+
+void LoopInterchanger::Run(const koopa_raw_program_t *raw) {
+    for (uint32_t i = 0; i < raw->funcs.len; ++i) {
+        koopa_raw_function_t kfunc = (koopa_raw_function_t)raw->funcs.buffer[i];
+        if (kfunc->bbs.len == 0)
+            continue;
+        AliasAnalysis aa(kfunc);
+        alias = &aa;
+        // 只改写指令, 块的下标不变
+        for (const CountedLoop &loop : FindCountedLoops(kfunc)) {
+            inner = loop;
+            if (match_nest(kfunc) && legal_and_profitable(kfunc)) {
+                interchange(kfunc);
+                ++interchanged;
+            }
+        }
+    }
+}
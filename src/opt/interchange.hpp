@@ -0,0 +1,76 @@
+#ifndef INTERCHANGE_H
+#define INTERCHANGE_H
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+#include <koopa.h>
+
+#include "opt/alias.hpp"
+#include "opt/loop.hpp"
+
+// Interchange of perfect nests of two counted loops (see `CountedLoop`) whose inner loop
+// walks memory with a larger stride than the outer one, like `c[i][j] += a[i][k] * b[k][j]`
+// with `k` inside `j`:
+//
+//     pre:   ...; store v, @i; br i < n, head, exit
+//     head:  store c, @j; br j < m, inner, end      (the inner loop, over j)
+//     end:   store (load @i) + s, @i; jump latch
+//     latch: br i < n, head, exit
+//
+// The two loops trade their variables, starts, bounds and steps, so j runs outside and i
+// inside. The nest must be rectangular: `c` a constant, `n` and `m` constants or variables
+// the nest does not store to, and neither `i` nor `j` read after the nest.
+//
+// Legality: the body has no call, return or break, and stores to array elements only
+// (besides the increment of j). Every address is an offset `a * i + b * j + r + c` into a
+// local array, a global or an array parameter, which alias as `AliasAnalysis` says. For
+// a pair of accesses, one of them a store, to the same object the offsets must have the
+// same a, b and r, and no iterations (i1, j1), (i2, j2) with i1 < i2 and j1 > j2 may meet
+// on one element. With constant bounds this is searched for; otherwise
+// only `a = 0`, `b = 0`, or a row of the last dimension (a a multiple of its length,
+// 0 < |b| < length, the same c) is accepted, assuming the subscripts are in bounds.
+//
+// Profit: `min(|a|, 16)` summed over the accesses is the stride of the outer loop, and `b`
+// that of the inner one; the loops are interchanged to put the smaller one inside.
+//
+// Nests are not tiled: once the inner loop has unit stride, tiling only pays off for rows
+// larger than the data cache and costs loop overhead everywhere else.
+class LoopInterchanger {
+    // Offset `a * i + b * j + rest + c` from `root`, in ints. `rest` is nullptr or the same
+    // in the whole nest.
+    struct Affine {
+        int64_t a = 0, b = 0, c = 0;
+        koopa_raw_value_t rest = nullptr;
+    };
+    struct Access {
+        koopa_raw_value_t root;
+        bool param;
+        Affine offset;
+        bool store;
+    };
+
+    // The nest being checked and values about it.
+    const AliasAnalysis *alias = nullptr;
+    CountedLoop outer, inner;
+    koopa_raw_value_t outer_init;
+    std::set<koopa_raw_value_t> defined, stored, after_incr;
+    std::vector<Access> accesses;
+
+    bool match_nest(koopa_raw_function_t kfunc);
+    bool invariant(koopa_raw_value_t kval);
+    bool affine(koopa_raw_value_t kval, Affine &res);
+    bool address(koopa_raw_value_t kval, Access &res);
+    bool collect(koopa_raw_function_t kfunc);
+    bool crosses(const Access &x, const Access &y);
+    bool legal_and_profitable(koopa_raw_function_t kfunc);
+    void interchange(koopa_raw_function_t kfunc);
+
+public:
+    // Nests interchanged, over all runs.
+    size_t interchanged = 0;
+
+    void Run(const koopa_raw_program_t *raw);
+};
+#endif
@@ -0,0 +1,65 @@
+#ifndef IR_UTIL_H
+#define IR_UTIL_H
+
+#include <cstdint>
+
+#include <koopa.h>
+
+// Helpers shared by the passes over the raw program in `src/opt`.
+
+// Call `f` on a reference to every value operand of instruction `kval`, so a pass can
+// read or replace them in place. Block targets of `br`/`jump` are not operands.
+template <typename F>
+inline void for_each_operand(koopa_raw_value_data *kval, F f) {
+    koopa_raw_value_kind_t &kind = kval->kind;
+    switch (kind.tag) {
+    case KOOPA_RVT_LOAD:
+        f(kind.data.load.src);
+        break;
+    case KOOPA_RVT_STORE:
+        f(kind.data.store.value);
+        f(kind.data.store.dest);
+        break;
+    case KOOPA_RVT_GET_PTR:
+        f(kind.data.get_ptr.src);
+        f(kind.data.get_ptr.index);
+        break;
+    case KOOPA_RVT_GET_ELEM_PTR:
+        f(kind.data.get_elem_ptr.src);
+        f(kind.data.get_elem_ptr.index);
+        break;
+    case KOOPA_RVT_BINARY:
+        f(kind.data.binary.lhs);
+        f(kind.data.binary.rhs);
+        break;
+    case KOOPA_RVT_BRANCH:
+        f(kind.data.branch.cond);
+        break;
+    case KOOPA_RVT_CALL:
+        for (uint32_t i = 0; i < kind.data.call.args.len; ++i)
+            f(((koopa_raw_value_t *)kind.data.call.args.buffer)[i]);
+        break;
+    case KOOPA_RVT_RETURN:
+        if (kind.data.ret.value)
+            f(kind.data.ret.value);
+        break;
+    default:
+        break;
+    }
+}
+
+inline bool is_const(koopa_raw_value_t kval) {
+    return kval->kind.tag == KOOPA_RVT_INTEGER;
+}
+
+inline int32_t const_value(koopa_raw_value_t kval) {
+    return kval->kind.data.integer.value;
+}
+
+// 以 int 为单位的大小
+inline int64_t type_ints(koopa_raw_type_t ty) {
+    if (ty->tag == KOOPA_RTT_ARRAY)
+        return type_ints(ty->data.array.base) * ty->data.array.len;
+    return 1;
+}
+#endif
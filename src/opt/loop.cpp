@@ -0,0 +1,189 @@
+#include "opt/loop.hpp"
+
+#include <map>
+
+#include "opt/ir_util.hpp"
+
+int64_t CountedLoop::TripCount() const {
+    if (!has_init || bound_var)
+        return -1;
+    int64_t n = const_value(bound) + (op == KOOPA_RBO_LE ? 1 : 0);
+    if (init >= n)
+        return 0;
+    return (n - init + step - 1) / step;
+}
+
+static koopa_raw_value_t terminator(koopa_raw_basic_block_t kblk) {
+    return kblk->insts.len ? (koopa_raw_value_t)kblk->insts.buffer[kblk->insts.len - 1] : nullptr;
+}
+
+static bool is_load_of(koopa_raw_value_t kval, koopa_raw_value_t var) {
+    return kval->kind.tag == KOOPA_RVT_LOAD && kval->kind.data.load.src == var;
+}
+
+bool MatchLatch(koopa_raw_basic_block_t kblk, CountedLoop &loop) {
+    // latch: load @i; (load @n;) lt/le; br
+    koopa_raw_value_t br = terminator(kblk);
+    if (kblk->insts.len < 3 || kblk->insts.len > 4 || br->kind.tag != KOOPA_RVT_BRANCH)
+        return false;
+    koopa_raw_value_t cmp = br->kind.data.branch.cond;
+    if (cmp->kind.tag != KOOPA_RVT_BINARY || (cmp->kind.data.binary.op != KOOPA_RBO_LT &&
+                                              cmp->kind.data.binary.op != KOOPA_RBO_LE))
+        return false;
+    koopa_raw_value_t lhs = cmp->kind.data.binary.lhs, rhs = cmp->kind.data.binary.rhs;
+    if (lhs->kind.tag != KOOPA_RVT_LOAD || lhs->kind.data.load.src->kind.tag != KOOPA_RVT_ALLOC)
+        return false;
+    loop.iv = lhs->kind.data.load.src;
+    loop.op = cmp->kind.data.binary.op;
+    loop.bound = rhs;
+    loop.bound_var = nullptr;
+    if (rhs->kind.tag == KOOPA_RVT_LOAD)
+        loop.bound_var = rhs->kind.data.load.src;
+    else if (!is_const(rhs))
+        return false;
+    if (loop.bound_var == loop.iv)
+        return false;
+    loop.exit = br->kind.data.branch.false_bb;
+    return true;
+}
+//
+// Check the latch `bbs[latch]` branching back to `bbs[head]` and fill in `loop`.
+//
+static bool match_loop(koopa_raw_function_t kfunc, const std::map<koopa_raw_basic_block_t, size_t> &index,
+                       size_t head, size_t latch, CountedLoop &loop) {
+    koopa_raw_basic_block_t *bbs = (koopa_raw_basic_block_t *)kfunc->bbs.buffer;
+    auto pos = [&](koopa_raw_basic_block_t kblk) {
+        auto it = index.find(kblk);
+        return it == index.end() ? kfunc->bbs.len : it->second;
+    };
+    auto inside = [&](koopa_raw_basic_block_t kblk) {
+        size_t i = pos(kblk);
+        return i >= head && i <= latch;
+    };
+
+    if (!MatchLatch(bbs[latch], loop))
+        return false;
+    loop.head = head;
+    loop.latch = latch;
+    if (inside(loop.exit))
+        return false;
+
+    // the body: one store to @i, no store to @n, one jump to the latch, no inner loop
+    bool found_incr = false, has_call = false;
+    size_t latch_jumps = 0, jump_block = 0;
+    loop.size = 0;
+    for (size_t b = head; b < latch; ++b) {
+        koopa_raw_basic_block_t kblk = bbs[b];
+        loop.size += kblk->insts.len;
+        for (uint32_t j = 0; j < kblk->insts.len; ++j) {
+            koopa_raw_value_t kval = (koopa_raw_value_t)kblk->insts.buffer[j];
+            switch (kval->kind.tag) {
+            case KOOPA_RVT_STORE: {
+                koopa_raw_value_t dest = kval->kind.data.store.dest;
+                if (dest == loop.bound_var)
+                    return false;
+                if (dest != loop.iv)
+                    break;
+                if (found_incr)
+                    return false;
+                // store %v + s, @i
+                koopa_raw_value_t value = kval->kind.data.store.value;
+                if (value->kind.tag != KOOPA_RVT_BINARY || value->kind.data.binary.op != KOOPA_RBO_ADD ||
+                    !is_load_of(value->kind.data.binary.lhs, loop.iv) || !is_const(value->kind.data.binary.rhs))
+                    return false;
+                loop.step = const_value(value->kind.data.binary.rhs);
+                if (loop.step <= 0 || loop.step > 1024)
+                    return false;
+                found_incr = true;
+                loop.incr = b;
+                break;
+            }
+            case KOOPA_RVT_CALL:
+                has_call = true;
+                break;
+            case KOOPA_RVT_BRANCH: {
+                koopa_raw_basic_block_t t = kval->kind.data.branch.true_bb, f = kval->kind.data.branch.false_bb;
+                // 分支到 latch 或者向回跳 (内层循环)
+                if (pos(t) == latch || pos(f) == latch || (inside(t) && pos(t) <= b) || (inside(f) && pos(f) <= b))
+                    return false;
+                break;
+            }
+            case KOOPA_RVT_JUMP: {
+                koopa_raw_basic_block_t t = kval->kind.data.jump.target;
+                if (pos(t) == latch) {
+                    ++latch_jumps;
+                    jump_block = b;
+                }
+                else if (inside(t) && pos(t) <= b)
+                    return false;
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+    if (!found_incr || latch_jumps != 1 || jump_block != loop.incr)
+        return false;
+    if (has_call && loop.bound_var && loop.bound_var->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
+        return false;
+
+    // the only way in from outside is the guard of `pre`
+    size_t pre = kfunc->bbs.len;
+    for (size_t b = 0; b < kfunc->bbs.len; ++b) {
+        if (b >= head && b <= latch)
+            continue;
+        koopa_raw_value_t term = terminator(bbs[b]);
+        if (!term)
+            continue;
+        bool enters = false;
+        if (term->kind.tag == KOOPA_RVT_BRANCH)
+            enters = inside(term->kind.data.branch.true_bb) || inside(term->kind.data.branch.false_bb);
+        else if (term->kind.tag == KOOPA_RVT_JUMP)
+            enters = inside(term->kind.data.jump.target);
+        if (!enters)
+            continue;
+        if (pre != kfunc->bbs.len || term->kind.tag != KOOPA_RVT_BRANCH ||
+            term->kind.data.branch.true_bb != bbs[head] || term->kind.data.branch.false_bb != loop.exit)
+            return false;
+        pre = b;
+    }
+    if (pre == kfunc->bbs.len)
+        return false;
+    loop.pre = pre;
+
+    // the last store to @i in `pre`
+    loop.has_init = false;
+    koopa_raw_basic_block_t pblk = bbs[pre];
+    for (uint32_t j = pblk->insts.len; j-- > 0; ) {
+        koopa_raw_value_t kval = (koopa_raw_value_t)pblk->insts.buffer[j];
+        if (kval->kind.tag == KOOPA_RVT_STORE && kval->kind.data.store.dest == loop.iv) {
+            if (is_const(kval->kind.data.store.value)) {
+                loop.has_init = true;
+                loop.init = const_value(kval->kind.data.store.value);
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+std::vector<CountedLoop> FindCountedLoops(koopa_raw_function_t kfunc) {
+    std::vector<CountedLoop> res;
+    koopa_raw_basic_block_t *bbs = (koopa_raw_basic_block_t *)kfunc->bbs.buffer;
+    std::map<koopa_raw_basic_block_t, size_t> index;
+    for (size_t i = 0; i < kfunc->bbs.len; ++i)
+        index[bbs[i]] = i;
+    for (size_t latch = 0; latch < kfunc->bbs.len; ++latch) {
+        koopa_raw_value_t br = terminator(bbs[latch]);
+        if (!br || br->kind.tag != KOOPA_RVT_BRANCH)
+            continue;
+        auto it = index.find(br->kind.data.branch.true_bb);
+        if (it == index.end() || it->second >= latch)
+            continue;
+        CountedLoop loop;
+        if (match_loop(kfunc, index, it->second, latch, loop))
+            res.push_back(loop);
+    }
+    return res;
+}
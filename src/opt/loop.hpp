@@ -0,0 +1,44 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include <cstdint>
+#include <vector>
+
+#include <koopa.h>
+
+// A counted loop of the raw program, as `WhileAST` builds `while (i < n) { ...; i = i + s; }`
+// after rotation:
+//
+//     pre:     ...; br %guard, head, exit
+//     head:    ...                                 body: blocks head .. latch - 1 of `bbs`
+//     ...
+//     incr:    ...; store %v + s, @i; jump latch    %v is a load of @i
+//     latch:   %i = load @i; %c = lt %i, n; br %c, head, exit
+//
+// `@i` is a local variable only stored by the increment, `s` is a positive constant, `n` is a
+// constant or a load of a variable the loop does not store to (nor calls anything, if it is a
+// global), `<=` works as well as `<`. Only `incr` jumps to the latch, so the body has no
+// `continue`, only `pre` enters the loop from outside, and the body has no inner loop.
+struct CountedLoop {
+    size_t pre, head, incr, latch;         // indices into `bbs`
+    koopa_raw_basic_block_t exit;
+    koopa_raw_value_t iv;                   // alloc of `i`
+    int32_t step;
+    koopa_raw_binary_op_t op;               // KOOPA_RBO_LT or KOOPA_RBO_LE
+    koopa_raw_value_t bound;                // `n` as used by the latch
+    koopa_raw_value_t bound_var;            // variable loaded for `n`, nullptr if constant
+    bool has_init;                          // `pre` stores the constant `init` to `@i`
+    int32_t init;
+    size_t size;                            // instructions of the body
+
+    // Number of iterations if `init` and `n` are constants, -1 otherwise.
+    int64_t TripCount() const;
+};
+
+// Fill in `iv`, `op`, `bound`, `bound_var` and `exit` of `loop` from the test of `kblk`, if it
+// is a latch of the form above.
+bool MatchLatch(koopa_raw_basic_block_t kblk, CountedLoop &loop);
+
+// Counted loops of `kfunc`, in the order of their latches.
+std::vector<CountedLoop> FindCountedLoops(koopa_raw_function_t kfunc);
+#endif
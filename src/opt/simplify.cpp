@@ -0,0 +1,390 @@
+#include "opt/simplify.hpp"
+
+#include <utility>
+
+#include "opt/alias.hpp"
+#include "opt/ir_util.hpp"
+#include "utils/koopa_util.hpp"
+
+static bool is_commutative(koopa_raw_binary_op_t op) {
+    return op == KOOPA_RBO_ADD || op == KOOPA_RBO_MUL || op == KOOPA_RBO_AND || op == KOOPA_RBO_OR ||
+           op == KOOPA_RBO_XOR || op == KOOPA_RBO_EQ || op == KOOPA_RBO_NOT_EQ;
+}
+
+static bool is_associative(koopa_raw_binary_op_t op) {
+    return op == KOOPA_RBO_ADD || op == KOOPA_RBO_MUL || op == KOOPA_RBO_AND || op == KOOPA_RBO_OR ||
+           op == KOOPA_RBO_XOR;
+}
+
+static bool is_compare(koopa_raw_binary_op_t op) {
+    return op == KOOPA_RBO_EQ || op == KOOPA_RBO_NOT_EQ || op == KOOPA_RBO_LT ||
+           op == KOOPA_RBO_GT || op == KOOPA_RBO_LE || op == KOOPA_RBO_GE;
+}
+
+// `b op a` for `a op b`.
+static koopa_raw_binary_op_t mirror(koopa_raw_binary_op_t op) {
+    switch (op) {
+    case KOOPA_RBO_LT: return KOOPA_RBO_GT;
+    case KOOPA_RBO_GT: return KOOPA_RBO_LT;
+    case KOOPA_RBO_LE: return KOOPA_RBO_GE;
+    case KOOPA_RBO_GE: return KOOPA_RBO_LE;
+    default: return op;
+    }
+}
+
+// `!(a op b)`.
+static koopa_raw_binary_op_t inverse(koopa_raw_binary_op_t op) {
+    switch (op) {
+    case KOOPA_RBO_EQ: return KOOPA_RBO_NOT_EQ;
+    case KOOPA_RBO_NOT_EQ: return KOOPA_RBO_EQ;
+    case KOOPA_RBO_LT: return KOOPA_RBO_GE;
+    case KOOPA_RBO_GE: return KOOPA_RBO_LT;
+    case KOOPA_RBO_GT: return KOOPA_RBO_LE;
+    case KOOPA_RBO_LE: return KOOPA_RBO_GT;
+    default: return op;
+    }
+}
+
+// Operand order of commutative operators: the higher rank goes left.
+static int rank(koopa_raw_value_t kval) {
+    switch (kval->kind.tag) {
+    case KOOPA_RVT_INTEGER:
+        return 0;
+    case KOOPA_RVT_FUNC_ARG_REF:
+    case KOOPA_RVT_GLOBAL_ALLOC:
+    case KOOPA_RVT_ALLOC:
+        return 1;
+    case KOOPA_RVT_LOAD:
+        return 2;
+    default:
+        return 3;
+    }
+}
+
+// `l op r` with the semantics of RV32IM, false if it traps or is left to run time
+// (division by 0, INT32_MIN / -1).
+static bool fold(koopa_raw_binary_op_t op, int32_t l, int32_t r, int32_t &res) {
+    uint32_t ul = l, ur = r;
+    switch (op) {
+    case KOOPA_RBO_NOT_EQ: res = l != r; break;
+    case KOOPA_RBO_EQ: res = l == r; break;
+    case KOOPA_RBO_GT: res = l > r; break;
+    case KOOPA_RBO_LT: res = l < r; break;
+    case KOOPA_RBO_GE: res = l >= r; break;
+    case KOOPA_RBO_LE: res = l <= r; break;
+    case KOOPA_RBO_ADD: res = (int32_t)(ul + ur); break;
+    case KOOPA_RBO_SUB: res = (int32_t)(ul - ur); break;
+    case KOOPA_RBO_MUL: res = (int32_t)(ul * ur); break;
+    case KOOPA_RBO_DIV:
+    case KOOPA_RBO_MOD:
+        if (r == 0 || (l == INT32_MIN && r == -1))
+            return false;
+        res = op == KOOPA_RBO_DIV ? l / r : l % r;
+        break;
+    case KOOPA_RBO_AND: res = l & r; break;
+    case KOOPA_RBO_OR: res = l | r; break;
+    case KOOPA_RBO_XOR: res = l ^ r; break;
+    case KOOPA_RBO_SHL: res = (int32_t)(ul << (r & 31)); break;
+    case KOOPA_RBO_SHR: res = (int32_t)(ul >> (r & 31)); break;
+    case KOOPA_RBO_SAR: res = l >> (r & 31); break;
+    default: return false;
+    }
+    return true;
+}
+
+// The binary `kval` is, if it has a constant rhs.
+static const koopa_raw_binary_t *const_rhs_binary(koopa_raw_value_t kval, koopa_raw_binary_op_t op) {
+    if (kval->kind.tag != KOOPA_RVT_BINARY)
+        return nullptr;
+    const koopa_raw_binary_t &bin = kval->kind.data.binary;
+    return bin.op == op && is_const(bin.rhs) ? &bin : nullptr;
+}
+
+koopa_raw_value_t Simplifier::resolve(koopa_raw_value_t kval) {
+    auto it = repl.find(kval);
+    while (it != repl.end()) {
+        kval = it->second;
+        it = repl.find(kval);
+    }
+    return kval;
+}
+
+void Simplifier::resolve_operands(koopa_raw_value_data *kval) {
+    for_each_operand(kval, [this](koopa_raw_value_t &op) {
+        koopa_raw_value_t r = resolve(op);
+        if (r != op) {
+            --uses[op];
+            ++uses[r];
+            op = r;
+        }
+    });
+}
+
+// `kval` is replaced, its operands lose a use.
+void Simplifier::drop_operands(koopa_raw_value_data *kval) {
+    for_each_operand(kval, [this](koopa_raw_value_t &op) { --uses[op]; });
+}
+
+// New binary placed before the instruction being simplified, simplified itself first.
+koopa_raw_value_t Simplifier::emit_binary(koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs) {
+    koopa_raw_value_data *res = BinaryInst(op, lhs, rhs);
+    ++uses[lhs];
+    ++uses[rhs];
+    if (koopa_raw_value_t r = simplify_binary(res)) {
+        drop_operands(res);
+        return r;
+    }
+    insts.push_back(res);
+    return res;
+}
+//
+// Simplify `kval` in place. Returns the value replacing it, or nullptr if it stays.
+//
+koopa_raw_value_t Simplifier::simplify_binary(koopa_raw_value_data *kval) {
+    koopa_raw_binary_t &bin = kval->kind.data.binary;
+    auto set = [this](koopa_raw_value_t &slot, koopa_raw_value_t v) {
+        --uses[slot];
+        ++uses[v];
+        slot = v;
+    };
+    for (;;) {
+        koopa_raw_value_t lhs = bin.lhs, rhs = bin.rhs;
+        // operand order
+        if (is_commutative(bin.op) && (is_const(lhs) ? !is_const(rhs) : rank(lhs) < rank(rhs)))
+            std::swap(bin.lhs, bin.rhs);
+        else if (is_compare(bin.op) && is_const(lhs) && !is_const(rhs)) {
+            std::swap(bin.lhs, bin.rhs);
+            bin.op = mirror(bin.op);
+        }
+        lhs = bin.lhs;
+        rhs = bin.rhs;
+
+        int32_t res;
+        if (is_const(lhs) && is_const(rhs) && fold(bin.op, const_value(lhs), const_value(rhs), res))
+            return make_koopa_interger(res);
+        if (lhs == rhs) {
+            switch (bin.op) {
+            case KOOPA_RBO_SUB:
+            case KOOPA_RBO_XOR:
+            case KOOPA_RBO_NOT_EQ:
+            case KOOPA_RBO_LT:
+            case KOOPA_RBO_GT:
+                return make_koopa_interger(0);
+            case KOOPA_RBO_EQ:
+            case KOOPA_RBO_LE:
+            case KOOPA_RBO_GE:
+                return make_koopa_interger(1);
+            case KOOPA_RBO_AND:
+            case KOOPA_RBO_OR:
+                return lhs;
+            default:
+                break;
+            }
+        }
+
+        if (!is_const(rhs)) {
+            // 0 - (0 - a) => a, a + (0 - b) => a - b
+            bool rhs_neg = rhs->kind.tag == KOOPA_RVT_BINARY && rhs->kind.data.binary.op == KOOPA_RBO_SUB &&
+                           is_const(rhs->kind.data.binary.lhs) && const_value(rhs->kind.data.binary.lhs) == 0;
+            if (rhs_neg && bin.op == KOOPA_RBO_SUB && is_const(lhs) && const_value(lhs) == 0)
+                return rhs->kind.data.binary.rhs;
+            if (rhs_neg && bin.op == KOOPA_RBO_ADD) {
+                bin.op = KOOPA_RBO_SUB;
+                set(bin.rhs, rhs->kind.data.binary.rhs);
+                continue;
+            }
+            if (!is_associative(bin.op))
+                return nullptr;
+            // (a op c) op b => (a op b) op c, 常量留在链的最外层
+            const koopa_raw_binary_t *inner = nullptr;
+            koopa_raw_value_t other = nullptr;
+            if ((inner = const_rhs_binary(lhs, bin.op)) && uses[lhs] == 1)
+                other = rhs;
+            else if ((inner = const_rhs_binary(rhs, bin.op)) && uses[rhs] == 1)
+                other = lhs;
+            else
+                return nullptr;
+            koopa_raw_value_t a = inner->lhs, c = inner->rhs;
+            // 先放开原来的操作数, 新指令里的 other 才可能只有一个使用者
+            set(bin.lhs, c);
+            set(bin.rhs, c);
+            set(bin.lhs, emit_binary(bin.op, a, other));
+            continue;
+        }
+
+        int32_t c = const_value(rhs);
+        switch (bin.op) {
+        case KOOPA_RBO_SUB:
+            if (c == INT32_MIN)
+                break;
+            bin.op = KOOPA_RBO_ADD;
+            set(bin.rhs, make_koopa_interger(-c));
+            continue;
+        case KOOPA_RBO_ADD:
+        case KOOPA_RBO_OR:
+        case KOOPA_RBO_XOR:
+        case KOOPA_RBO_SHL:
+        case KOOPA_RBO_SHR:
+        case KOOPA_RBO_SAR:
+            if (c == 0)
+                return lhs;
+            if (bin.op == KOOPA_RBO_OR && c == -1)
+                return rhs;
+            break;
+        case KOOPA_RBO_AND:
+            if (c == 0)
+                return rhs;
+            if (c == -1)
+                return lhs;
+            break;
+        case KOOPA_RBO_MUL:
+            if (c == 0)
+                return rhs;
+            if (c == 1)
+                return lhs;
+            if (c == -1) {
+                bin.op = KOOPA_RBO_SUB;
+                set(bin.rhs, lhs);
+                set(bin.lhs, make_koopa_interger(0));
+                continue;
+            }
+            break;
+        case KOOPA_RBO_DIV:
+            if (c == 1)
+                return lhs;
+            break;
+        case KOOPA_RBO_MOD:
+            if (c == 1 || c == -1)
+                return make_koopa_interger(0);
+            break;
+        default:
+            break;
+        }
+
+        // (a op c1) op c2 => a op (c1 op c2)
+        if (is_associative(bin.op)) {
+            if (const koopa_raw_binary_t *inner = const_rhs_binary(lhs, bin.op)) {
+                fold(bin.op, const_value(inner->rhs), c, res);
+                set(bin.lhs, inner->lhs);
+                set(bin.rhs, make_koopa_interger(res));
+                continue;
+            }
+        }
+        // 比较的结果只有 0 和 1: (a < b) != 0 即 a < b, (a < b) == 0 即 a >= b
+        if ((bin.op == KOOPA_RBO_EQ || bin.op == KOOPA_RBO_NOT_EQ) && (c == 0 || c == 1) &&
+            lhs->kind.tag == KOOPA_RVT_BINARY && is_compare(lhs->kind.data.binary.op)) {
+            const koopa_raw_binary_t &cmp = lhs->kind.data.binary;
+            if ((bin.op == KOOPA_RBO_NOT_EQ) == (c == 0))
+                return lhs;
+            bin.op = inverse(cmp.op);
+            set(bin.rhs, cmp.rhs);
+            set(bin.lhs, cmp.lhs);
+            continue;
+        }
+        return nullptr;
+    }
+}
+
+void Simplifier::simplify_func(koopa_raw_function_t kfunc) {
+    repl.clear();
+    uses.clear();
+    for (uint32_t i = 0; i < kfunc->bbs.len; ++i) {
+        koopa_raw_basic_block_t kblk = (koopa_raw_basic_block_t)kfunc->bbs.buffer[i];
+        for (uint32_t j = 0; j < kblk->insts.len; ++j)
+            for_each_operand((koopa_raw_value_data *)kblk->insts.buffer[j],
+                [this](koopa_raw_value_t &op) { ++uses[op]; });
+    }
+
+    AliasAnalysis alias(kfunc);
+    for (uint32_t i = 0; i < kfunc->bbs.len; ++i) {
+        koopa_raw_basic_block_data_t *kblk = (koopa_raw_basic_block_data_t *)kfunc->bbs.buffer[i];
+        insts.clear();
+        avail.clear();
+        for (uint32_t j = 0; j < kblk->insts.len; ++j) {
+            koopa_raw_value_data *kval = (koopa_raw_value_data *)kblk->insts.buffer[j];
+            resolve_operands(kval);
+            koopa_raw_value_t r = nullptr;
+            switch (kval->kind.tag) {
+            case KOOPA_RVT_LOAD: {
+                auto it = avail.find(kval->kind.data.load.src);
+                if (it != avail.end())
+                    r = it->second;
+                else
+                    avail[kval->kind.data.load.src] = kval;
+                break;
+            }
+            case KOOPA_RVT_STORE:
+                // 只丢掉可能是它的别名的地址
+                for (auto it = avail.begin(); it != avail.end();) {
+                    if (alias.Alias(it->first, kval->kind.data.store.dest) != AliasAnalysis::NO_ALIAS)
+                        it = avail.erase(it);
+                    else
+                        ++it;
+                }
+                // 参数只在入口处存到栈上, 后端不能把它当作普通的值读取
+                if (kval->kind.data.store.value->kind.tag != KOOPA_RVT_FUNC_ARG_REF)
+                    avail[kval->kind.data.store.dest] = kval->kind.data.store.value;
+                break;
+            case KOOPA_RVT_CALL:
+                avail.clear();
+                break;
+            case KOOPA_RVT_BINARY:
+                r = simplify_binary(kval);
+                break;
+            default:
+                break;
+            }
+            if (r) {
+                drop_operands(kval);
+                repl[kval] = r;
+                ++changed;
+            }
+            else
+                insts.push_back(kval);
+        }
+        kblk->insts = make_koopa_raw_slice(insts, KOOPA_RSIK_VALUE);
+    }
+    remove_dead(kfunc);
+}
+//
+// Remove loads, pointers and binaries nothing uses, until there are none left.
+//
+void Simplifier::remove_dead(koopa_raw_function_t kfunc) {
+    bool removed = true;
+    while (removed) {
+        removed = false;
+        uses.clear();
+        for (uint32_t i = 0; i < kfunc->bbs.len; ++i) {
+            koopa_raw_basic_block_t kblk = (koopa_raw_basic_block_t)kfunc->bbs.buffer[i];
+            for (uint32_t j = 0; j < kblk->insts.len; ++j)
+                for_each_operand((koopa_raw_value_data *)kblk->insts.buffer[j],
+                    [this](koopa_raw_value_t &op) { ++uses[op]; });
+        }
+        for (uint32_t i = 0; i < kfunc->bbs.len; ++i) {
+            koopa_raw_basic_block_data_t *kblk = (koopa_raw_basic_block_data_t *)kfunc->bbs.buffer[i];
+            insts.clear();
+            for (uint32_t j = 0; j < kblk->insts.len; ++j) {
+                koopa_raw_value_t kval = (koopa_raw_value_t)kblk->insts.buffer[j];
+                koopa_raw_value_tag_t tag = kval->kind.tag;
+                bool pure = tag == KOOPA_RVT_BINARY || tag == KOOPA_RVT_LOAD ||
+                            tag == KOOPA_RVT_GET_PTR || tag == KOOPA_RVT_GET_ELEM_PTR;
+                if (pure && uses[kval] == 0) {
+                    removed = true;
+                    ++changed;
+                }
+                else
+                    insts.push_back(kval);
+            }
+            if (insts.size() != kblk->insts.len)
+                kblk->insts = make_koopa_raw_slice(insts, KOOPA_RSIK_VALUE);
+        }
+    }
+}
+
+void Simplifier::Run(const koopa_raw_program_t *raw) {
+    for (uint32_t i = 0; i < raw->funcs.len; ++i) {
+        koopa_raw_function_t kfunc = (koopa_raw_function_t)raw->funcs.buffer[i];
+        if (kfunc->bbs.len > 0)
+            simplify_func(kfunc);
+    }
+}
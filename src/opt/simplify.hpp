@@ -0,0 +1,51 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include <koopa.h>
+
+// Algebraic simplification of the raw program built by the front end, run before it is
+// generated to Koopa (`-koopa`), interpreted (`-interp`) or compiled (`-riscv`/`-perf`).
+//
+// Every instruction is visited in block order with its operands already simplified:
+// - constants go to the right of commutative operators and comparisons (`1 < x` is
+//   `x > 1`), otherwise instructions go left of loads, arguments and globals, and
+//   `x - c` is `x + (-c)`;
+// - constant operands are folded and identities (`x + 0`, `x * 1`, `x * 0`, `x - x`,
+//   `x == x`, ...) replace the instruction by an operand or a constant;
+// - chains of `+`, `*`, `&`, `|`, `^` are reassociated so their constants meet: `x + 1 + 2`
+//   is `x + 3`, `(i * 4) * 8` is `i * 32`, `(a + 1) + b` is `(a + b) + 1`;
+// - `0 - (0 - a)` is `a` and `a + (0 - b)` is `a - b`;
+// - a comparison compared with 0 or 1 is the comparison or its inverse (`!!x` is `x != 0`);
+// - a load of the address loaded or stored before in the same block, with no call and no
+//   store which may alias it (see `AliasAnalysis`) in between, is that value, so both `x`
+//   of `x - x` are the same value.
+// Loads, pointers and binaries which end up unused are removed.
+class Simplifier {
+    // Value replacing an instruction, and number of uses of every value.
+    std::map<koopa_raw_value_t, koopa_raw_value_t> repl;
+    std::map<koopa_raw_value_t, int> uses;
+    // Instructions of the block being rebuilt.
+    std::vector<const void *> insts;
+    // Value at an address, known from a load or store earlier in the block.
+    std::map<koopa_raw_value_t, koopa_raw_value_t> avail;
+
+    koopa_raw_value_t resolve(koopa_raw_value_t kval);
+    void resolve_operands(koopa_raw_value_data *kval);
+    void drop_operands(koopa_raw_value_data *kval);
+    koopa_raw_value_t simplify_binary(koopa_raw_value_data *kval);
+    koopa_raw_value_t emit_binary(koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs);
+    void simplify_func(koopa_raw_function_t kfunc);
+    void remove_dead(koopa_raw_function_t kfunc);
+
+public:
+    // Instructions replaced or removed, over all runs.
+    size_t changed = 0;
+
+    // Simplify every function of `raw` in place.
+    void Run(const koopa_raw_program_t *raw);
+};
+#endif
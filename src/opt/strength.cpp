@@ -0,0 +1,258 @@
+#include "opt/strength.hpp"
+
+#include <tuple>
+#include <utility>
+
+#include "opt/ir_util.hpp"
+#include "opt/unroll.hpp"
+#include "opt/vectorize.hpp"
+#include "utils/koopa_util.hpp"
+
+//
+// Whether `kval` has the same value in every iteration of `loop` and can be computed in `pre`.
+//
+bool StrengthReducer::invariant(koopa_raw_value_t kval, const CountedLoop &loop) {
+    if (!defined.count(kval))
+        return true;
+    const koopa_raw_value_kind_t &kind = kval->kind;
+    switch (kind.tag) {
+    case KOOPA_RVT_LOAD: {
+        koopa_raw_value_t src = kind.data.load.src;
+        if (src == loop.iv || stored.count(src) || defined.count(src))
+            return false;
+        if (src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
+            return !has_call && src->ty->data.pointer.base->tag != KOOPA_RTT_ARRAY;
+        return src->kind.tag == KOOPA_RVT_ALLOC && src->ty->data.pointer.base->tag != KOOPA_RTT_ARRAY;
+    }
+    case KOOPA_RVT_GET_PTR:
+        return invariant(kind.data.get_ptr.src, loop) && invariant(kind.data.get_ptr.index, loop);
+    case KOOPA_RVT_GET_ELEM_PTR:
+        return invariant(kind.data.get_elem_ptr.src, loop) && invariant(kind.data.get_elem_ptr.index, loop);
+    case KOOPA_RVT_BINARY:
+        // 提到 pre 里的除法可能在循环不执行时除以零
+        if (kind.data.binary.op == KOOPA_RBO_DIV || kind.data.binary.op == KOOPA_RBO_MOD)
+            return false;
+        return invariant(kind.data.binary.lhs, loop) && invariant(kind.data.binary.rhs, loop);
+    default:
+        return false;
+    }
+}
+//
+// Copy of the invariant `kval` computed by `insts` (the end of `pre`).
+//
+koopa_raw_value_t StrengthReducer::hoist(koopa_raw_value_t kval, std::vector<const void *> &insts) {
+    if (!defined.count(kval))
+        return kval;
+    auto it = hoisted.find(kval);
+    if (it != hoisted.end())
+        return it->second;
+    koopa_raw_value_data *copy = new_koopa_raw_value();
+    *copy = *kval;
+    copy->used_by = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
+    for_each_operand(copy, [&](koopa_raw_value_t &op) {
+        op = hoist(op, insts);
+    });
+    insts.push_back(copy);
+    hoisted[kval] = copy;
+    return copy;
+}
+//
+// Whether `kval` is affine in `i`, as `res`.
+//
+bool StrengthReducer::affine(koopa_raw_value_t kval, const CountedLoop &loop, Affine &res) {
+    if (is_const(kval)) {
+        res.c = const_value(kval);
+        return true;
+    }
+    if (kval->kind.tag == KOOPA_RVT_LOAD && kval->kind.data.load.src == loop.iv) {
+        // 自增之后的 load @i 是下一轮的 i
+        if (!defined.count(kval) || after_incr.count(kval))
+            return false;
+        iv_loads.insert(kval);
+        res.coef = 1;
+        return true;
+    }
+    if (invariant(kval, loop)) {
+        res.rest = kval;
+        return true;
+    }
+    if (kval->kind.tag != KOOPA_RVT_BINARY)
+        return false;
+    Affine lhs, rhs;
+    if (!affine(kval->kind.data.binary.lhs, loop, lhs) || !affine(kval->kind.data.binary.rhs, loop, rhs))
+        return false;
+    switch (kval->kind.data.binary.op) {
+    case KOOPA_RBO_ADD:
+        if (lhs.rest && rhs.rest)
+            return false;
+        res.coef = lhs.coef + rhs.coef;
+        res.c = lhs.c + rhs.c;
+        res.rest = lhs.rest ? lhs.rest : rhs.rest;
+        break;
+    case KOOPA_RBO_SUB:
+        if (rhs.rest)
+            return false;
+        res.coef = lhs.coef - rhs.coef;
+        res.c = lhs.c - rhs.c;
+        res.rest = lhs.rest;
+        break;
+    case KOOPA_RBO_MUL:
+        if (lhs.coef == 0 && !lhs.rest)
+            std::swap(lhs, rhs);
+        if (rhs.coef != 0 || rhs.rest || lhs.rest)
+            return false;
+        res.coef = lhs.coef * rhs.c;
+        res.c = lhs.c * rhs.c;
+        break;
+    default:
+        return false;
+    }
+    return res.coef >= INT32_MIN && res.coef <= INT32_MAX && res.c >= INT32_MIN && res.c <= INT32_MAX;
+}
+//
+// Reduce the accesses of `loop`, the pointer variables are added to `allocs`.
+//
+size_t StrengthReducer::reduce(koopa_raw_function_data_t *kfunc, const CountedLoop &loop,
+                               std::vector<const void *> &allocs) {
+    koopa_raw_basic_block_data_t **bbs = (koopa_raw_basic_block_data_t **)kfunc->bbs.buffer;
+    defined.clear();
+    stored.clear();
+    iv_loads.clear();
+    after_incr.clear();
+    hoisted.clear();
+    has_call = false;
+    uint32_t incr_pos = 0;
+    for (size_t b = loop.head; b < loop.latch; ++b)
+        for (uint32_t j = 0; j < bbs[b]->insts.len; ++j) {
+            koopa_raw_value_t kval = (koopa_raw_value_t)bbs[b]->insts.buffer[j];
+            defined.insert(kval);
+            if (kval->kind.tag == KOOPA_RVT_STORE) {
+                stored.insert(kval->kind.data.store.dest);
+                if (b == loop.incr && kval->kind.data.store.dest == loop.iv)
+                    incr_pos = j;
+            }
+            else if (kval->kind.tag == KOOPA_RVT_CALL)
+                has_call = true;
+        }
+    for (uint32_t j = incr_pos + 1; j < bbs[loop.incr]->insts.len; ++j)
+        after_incr.insert((koopa_raw_value_t)bbs[loop.incr]->insts.buffer[j]);
+
+    // accesses grouped by base, kind and index up to the constant, with their indices
+    typedef std::tuple<koopa_raw_value_t, koopa_raw_value_tag_t, int64_t, koopa_raw_value_t> Key;
+    std::vector<Key> keys;
+    std::map<Key, std::vector<std::pair<koopa_raw_value_data *, Affine>>> accesses;
+    for (size_t b = loop.head; b < loop.latch; ++b)
+        for (uint32_t j = 0; j < bbs[b]->insts.len; ++j) {
+            koopa_raw_value_data *kval = (koopa_raw_value_data *)bbs[b]->insts.buffer[j];
+            koopa_raw_value_t src, index;
+            if (kval->kind.tag == KOOPA_RVT_GET_ELEM_PTR) {
+                src = kval->kind.data.get_elem_ptr.src;
+                index = kval->kind.data.get_elem_ptr.index;
+            }
+            else if (kval->kind.tag == KOOPA_RVT_GET_PTR) {
+                src = kval->kind.data.get_ptr.src;
+                index = kval->kind.data.get_ptr.index;
+            }
+            else
+                continue;
+            Affine idx;
+            if (!affine(index, loop, idx) || idx.coef == 0 || !invariant(src, loop))
+                continue;
+            int64_t step = idx.coef * loop.step;
+            if (step < INT32_MIN || step > INT32_MAX)
+                continue;
+            Key key(src, kval->kind.tag, idx.coef, idx.rest);
+            if (!accesses.count(key))
+                keys.push_back(key);
+            accesses[key].emplace_back(kval, idx);
+        }
+
+    koopa_raw_basic_block_data_t *pre = bbs[loop.pre];
+    std::vector<const void *> pre_insts(pre->insts.buffer, pre->insts.buffer + pre->insts.len - 1);
+    koopa_raw_value_data *i0 = LoadInst(loop.iv);
+    pre_insts.push_back(i0);
+    for (koopa_raw_value_t kval : iv_loads)
+        hoisted[kval] = i0;
+    std::map<koopa_raw_value_t, std::vector<const void *>> before;
+    std::vector<const void *> step;
+    size_t res = 0;
+    for (const Key &key : keys) {
+        std::vector<std::pair<koopa_raw_value_data *, Affine>> &list = accesses[key];
+        // 单独的 a[i] 只省下一个移位, 还不够维护 @p 的开销
+        if (std::get<2>(key) == 1 && !std::get<3>(key) && list.size() == 1)
+            continue;
+        koopa_raw_value_data *first = list.front().first;
+        int64_t c0 = list.front().second.c;
+        koopa_raw_value_data *ptr = AllocType("@sr_ptr", first->ty);
+        allocs.push_back(ptr);
+
+        // pre: @p = base + x(i)
+        koopa_raw_value_t index = first->kind.tag == KOOPA_RVT_GET_ELEM_PTR ? first->kind.data.get_elem_ptr.index
+                                                                            : first->kind.data.get_ptr.index;
+        koopa_raw_value_t base = hoist(std::get<0>(key), pre_insts);
+        index = hoist(index, pre_insts);
+        koopa_raw_value_data *p0 = std::get<1>(key) == KOOPA_RVT_GET_ELEM_PTR ? GetElemPtrInst(base, index)
+                                                                              : GetPtrInst(base, index);
+        pre_insts.push_back(p0);
+        pre_insts.push_back(StoreInst(p0, ptr));
+
+        // body: 访问改成 getptr (load @p), c - c0, 类型不变, 原来的使用者不用改
+        for (auto &access : list) {
+            koopa_raw_value_data *kval = access.first;
+            koopa_raw_value_data *p = LoadInst(ptr);
+            before[kval].push_back(p);
+            kval->kind.tag = KOOPA_RVT_GET_PTR;
+            kval->kind.data.get_ptr.src = p;
+            kval->kind.data.get_ptr.index = make_koopa_interger((int32_t)(access.second.c - c0));
+            ++res;
+        }
+
+        // incr: @p = @p + a * s
+        koopa_raw_value_data *p = LoadInst(ptr);
+        koopa_raw_value_data *p1 = GetPtrInst(p, make_koopa_interger((int32_t)(std::get<2>(key) * loop.step)));
+        step.push_back(p);
+        step.push_back(p1);
+        step.push_back(StoreInst(p1, ptr));
+    }
+    if (res == 0)
+        return 0;
+    pre_insts.push_back(pre->insts.buffer[pre->insts.len - 1]);
+    pre->insts = make_koopa_raw_slice(pre_insts, KOOPA_RSIK_VALUE);
+
+    for (size_t b = loop.head; b < loop.latch; ++b) {
+        std::vector<const void *> insts;
+        for (uint32_t j = 0; j < bbs[b]->insts.len; ++j) {
+            koopa_raw_value_t kval = (koopa_raw_value_t)bbs[b]->insts.buffer[j];
+            // 步进放在 incr 的跳转之前, 自增之后的访问也用这一轮的 @p
+            if (b == loop.incr && j + 1 == bbs[b]->insts.len)
+                insts.insert(insts.end(), step.begin(), step.end());
+            auto it = before.find(kval);
+            if (it != before.end())
+                insts.insert(insts.end(), it->second.begin(), it->second.end());
+            insts.push_back(kval);
+        }
+        bbs[b]->insts = make_koopa_raw_slice(insts, KOOPA_RSIK_VALUE);
+    }
+    return res;
+}
+
+void StrengthReducer::Run(const koopa_raw_program_t *raw) {
+    for (uint32_t i = 0; i < raw->funcs.len; ++i) {
+        koopa_raw_function_data_t *kfunc = (koopa_raw_function_data_t *)raw->funcs.buffer[i];
+        if (kfunc->bbs.len == 0)
+            continue;
+        // 只插入指令, 块的下标不变
+        std::vector<const void *> allocs;
+        for (const CountedLoop &loop : FindCountedLoops(kfunc)) {
+            VectorLoop vl;
+            if (LoopUnroller::FullyUnrolls(loop) || (keep_vector_loops && MatchVectorLoop(kfunc, loop, vl)))
+                continue;
+            reduced += reduce(kfunc, loop, allocs);
+        }
+        if (allocs.empty())
+            continue;
+        koopa_raw_basic_block_data_t *entry = (koopa_raw_basic_block_data_t *)kfunc->bbs.buffer[0];
+        allocs.insert(allocs.end(), entry->insts.buffer, entry->insts.buffer + entry->insts.len);
+        entry->insts = make_koopa_raw_slice(allocs, KOOPA_RSIK_VALUE);
+    }
+}
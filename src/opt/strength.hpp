@@ -0,0 +1,62 @@
+#ifndef STRENGTH_H
+#define STRENGTH_H
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <koopa.h>
+
+#include "opt/loop.hpp"
+
+// Strength reduction of the array indexing in counted loops (see `CountedLoop`).
+//
+// `getelemptr base, %x` or `getptr base, %x`, with `base` the same in every iteration and
+// `%x` affine in the induction variable, `a * i + r + c` (`a` and `c` constants, `r` the same
+// in every iteration), is replaced by a pointer variable carried across iterations:
+//
+//     pre:   ...; %i0 = load @i; %p0 = getelemptr base, %x(%i0); store %p0, @p; br ...
+//     body:  %p = load @p; %e = getptr %p, c - c0
+//     incr:  store %v + s, @i; ...; %q = load @p; %q1 = getptr %q, a * s; store %q1, @p; jump latch
+//
+// The step of `@p` comes last, after the accesses which follow the increment of i. So the
+// body no longer multiplies the index by the strides: the front end flattens
+// `b[k][j]` of a parameter to `getptr b, k * 13 + j`, which becomes a step of 13 elements
+// per iteration of `k`. The computations of `base` and `%x` are copied to `pre`, they may
+// only use constants, values from outside the loop, and loads of scalar variables the loop
+// does not store to (or, for globals, call anything). Accesses differing only in `c`
+// (`a[i-1]`, `a[i]`, `a[i+1]`) share `@p`, the first one's `c` is `c0`. A lone `a[i + c]` is
+// left alone, it only costs a shift.
+//
+// Loops `LoopUnroller` fully unrolls are left alone, their indices become constants, and so
+// are the loops the backend vectorizes (`MatchVectorLoop`) if `keep_vector_loops` is set.
+class StrengthReducer {
+    // The loop being reduced: values it defines, variables it stores to, whether it calls.
+    std::set<koopa_raw_value_t> defined, stored;
+    bool has_call = false;
+    // Loads of `@i` in the loop before its increment, and the values after the increment.
+    std::set<koopa_raw_value_t> iv_loads, after_incr;
+    // Copies in `pre` of the loop-invariant values and the loads of `@i`.
+    std::map<koopa_raw_value_t, koopa_raw_value_t> hoisted;
+
+    // `coef * i + rest + c`, `rest` is nullptr or a loop-invariant value.
+    struct Affine {
+        int64_t coef = 0, c = 0;
+        koopa_raw_value_t rest = nullptr;
+    };
+
+    bool invariant(koopa_raw_value_t kval, const CountedLoop &loop);
+    bool affine(koopa_raw_value_t kval, const CountedLoop &loop, Affine &res);
+    koopa_raw_value_t hoist(koopa_raw_value_t kval, std::vector<const void *> &insts);
+    size_t reduce(koopa_raw_function_data_t *kfunc, const CountedLoop &loop, std::vector<const void *> &allocs);
+
+public:
+    // Leave the loops `MatchVectorLoop` accepts alone (-march with the V extension).
+    bool keep_vector_loops = false;
+    // Accesses reduced, over all runs.
+    size_t reduced = 0;
+
+    void Run(const koopa_raw_program_t *raw);
+};
+#endif
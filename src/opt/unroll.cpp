@@ -0,0 +1,237 @@
+#include "opt/unroll.hpp"
+
+#include <algorithm>
+#include <set>
+#include <string>
+
+#include "opt/ir_util.hpp"
+#include "opt/vectorize.hpp"
+#include "utils/koopa_util.hpp"
+
+static std::vector<koopa_raw_basic_block_data_t *> block_list(koopa_raw_function_t kfunc) {
+    std::vector<koopa_raw_basic_block_data_t *> res;
+    for (uint32_t i = 0; i < kfunc->bbs.len; ++i)
+        res.push_back((koopa_raw_basic_block_data_t *)kfunc->bbs.buffer[i]);
+    return res;
+}
+
+static void set_blocks(koopa_raw_function_data_t *kfunc, const std::vector<koopa_raw_basic_block_data_t *> &bbs) {
+    std::vector<const void *> buf(bbs.begin(), bbs.end());
+    kfunc->bbs = make_koopa_raw_slice(buf, KOOPA_RSIK_BASIC_BLOCK);
+}
+
+static void set_insts(koopa_raw_basic_block_data_t *kblk, const std::vector<const void *> &insts) {
+    kblk->insts = make_koopa_raw_slice(insts, KOOPA_RSIK_VALUE);
+}
+//
+// One copy of the body of `loop`, its jump to the latch goes to `next` instead.
+//
+std::vector<koopa_raw_basic_block_data_t *> LoopUnroller::clone_body(koopa_raw_function_t kfunc, const CountedLoop &loop,
+                                                                     koopa_raw_basic_block_t next) {
+    koopa_raw_basic_block_t *bbs = (koopa_raw_basic_block_t *)kfunc->bbs.buffer;
+    vmap.clear();
+    bmap.clear();
+    std::vector<koopa_raw_basic_block_data_t *> res;
+    for (size_t b = loop.head; b < loop.latch; ++b) {
+        res.push_back(BasicBlock(bbs[b]->name));
+        bmap[bbs[b]] = res.back();
+    }
+    bmap[bbs[loop.latch]] = next;
+    auto target = [this](koopa_raw_basic_block_t &kblk) {
+        auto it = bmap.find(kblk);
+        if (it != bmap.end())
+            kblk = it->second;
+    };
+
+    for (size_t b = loop.head; b < loop.latch; ++b) {
+        std::vector<const void *> insts;
+        for (uint32_t j = 0; j < bbs[b]->insts.len; ++j) {
+            koopa_raw_value_t kval = (koopa_raw_value_t)bbs[b]->insts.buffer[j];
+            koopa_raw_value_data *copy = new_koopa_raw_value();
+            *copy = *kval;
+            copy->used_by = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
+            if (kval->kind.tag == KOOPA_RVT_CALL) {
+                const koopa_raw_slice_t &args = kval->kind.data.call.args;
+                std::vector<const void *> buf(args.buffer, args.buffer + args.len);
+                copy->kind.data.call.args = make_koopa_raw_slice(buf, KOOPA_RSIK_VALUE);
+            }
+            for_each_operand(copy, [this](koopa_raw_value_t &op) {
+                auto it = vmap.find(op);
+                if (it != vmap.end())
+                    op = it->second;
+            });
+            if (copy->kind.tag == KOOPA_RVT_BRANCH) {
+                target(copy->kind.data.branch.true_bb);
+                target(copy->kind.data.branch.false_bb);
+            }
+            else if (copy->kind.tag == KOOPA_RVT_JUMP)
+                target(copy->kind.data.jump.target);
+            vmap[kval] = copy;
+            insts.push_back(copy);
+        }
+        set_insts(res[b - loop.head], insts);
+    }
+    return res;
+}
+//
+// Fill `kblk` with the test whether `factor` more iterations of `loop` run:
+// `i < n - (factor-1)*s` (or `<=`), branching to `more` or `less`.
+//
+// n - (factor-1)*s wraps for n within (factor-1)*s of INT32_MIN, `unroll` keeps such n
+// away from the test.
+void LoopUnroller::test_block(koopa_raw_basic_block_data_t *kblk, const CountedLoop &loop, int factor,
+                              koopa_raw_basic_block_t more, koopa_raw_basic_block_t less) {
+    std::vector<const void *> insts;
+    koopa_raw_value_data *i = LoadInst(loop.iv);
+    insts.push_back(i);
+    int32_t dist = (factor - 1) * loop.step;
+    koopa_raw_value_t bound;
+    if (!loop.bound_var)
+        bound = make_koopa_interger(const_value(loop.bound) - dist);
+    else {
+        koopa_raw_value_data *n = LoadInst(loop.bound_var);
+        koopa_raw_value_data *sub = BinaryInst(KOOPA_RBO_SUB, n, make_koopa_interger(dist));
+        insts.push_back(n);
+        insts.push_back(sub);
+        bound = sub;
+    }
+    koopa_raw_value_data *cmp = BinaryInst(loop.op, i, bound);
+    insts.push_back(cmp);
+    insts.push_back(BranchInst(cmp, more, less));
+    set_insts(kblk, insts);
+}
+
+bool LoopUnroller::FullyUnrolls(const CountedLoop &loop) {
+    int64_t trip = loop.TripCount();
+    return trip > 0 && (size_t)trip * loop.size <= FULL_BUDGET;
+}
+
+bool LoopUnroller::unroll(koopa_raw_function_data_t *kfunc, const CountedLoop &loop) {
+    std::vector<koopa_raw_basic_block_data_t *> bbs = block_list(kfunc);
+    koopa_raw_basic_block_data_t *pre = bbs[loop.pre];
+    koopa_raw_value_data *guard = (koopa_raw_value_data *)pre->insts.buffer[pre->insts.len - 1];
+    int64_t trip = loop.TripCount();
+
+    if (FullyUnrolls(loop) && is_const(guard->kind.data.branch.cond)) {
+        // 完全展开: 副本依次相连, 最后一个跳到出口, 原来的循环删掉
+        std::vector<std::vector<koopa_raw_basic_block_data_t *>> copies;
+        koopa_raw_basic_block_t next = loop.exit;
+        for (int64_t k = 0; k < trip; ++k) {
+            copies.push_back(clone_body(kfunc, loop, next));
+            next = copies.back().front();
+        }
+        std::vector<const void *> insts(pre->insts.buffer, pre->insts.buffer + pre->insts.len - 1);
+        insts.push_back(JumpInst(next));
+        set_insts(pre, insts);
+
+        std::vector<koopa_raw_basic_block_data_t *> res(bbs.begin(), bbs.begin() + loop.head);
+        for (auto it = copies.rbegin(); it != copies.rend(); ++it)
+            res.insert(res.end(), it->begin(), it->end());
+        res.insert(res.end(), bbs.begin() + loop.latch + 1, bbs.end());
+        set_blocks(kfunc, res);
+        ++full;
+        return true;
+    }
+
+    int factor = std::min<int>(MAX_FACTOR, PARTIAL_BUDGET / std::max<size_t>(loop.size, 1));
+    if (factor < 2 || (trip >= 0 && trip < factor))
+        return false;
+    int64_t dist = (int64_t)(factor - 1) * loop.step;
+    if (!loop.bound_var && (int64_t)const_value(loop.bound) - dist < INT32_MIN)
+        return false;
+
+    koopa_raw_basic_block_data_t *unroll_latch = BasicBlock("%unroll_latch");
+    std::vector<std::vector<koopa_raw_basic_block_data_t *>> copies;
+    koopa_raw_basic_block_t next = unroll_latch;
+    for (int k = 0; k < factor; ++k) {
+        copies.push_back(clone_body(kfunc, loop, next));
+        next = copies.back().front();
+    }
+    test_block(unroll_latch, loop, factor, next, bbs[loop.latch]);
+    koopa_raw_basic_block_data_t *unroll_pre = BasicBlock("%unroll_pre");
+    koopa_raw_basic_block_data_t *unroll_test = unroll_pre;
+    if (loop.bound_var) {
+        // n - dist 会回绕时 (i 仍可能小于 n) 只走原来的循环, 副本和 unroll_latch 就不会遇到它
+        unroll_test = BasicBlock("%unroll_test");
+        koopa_raw_value_data *n = LoadInst(loop.bound_var);
+        koopa_raw_value_data *wraps = BinaryInst(KOOPA_RBO_LT, n, make_koopa_interger((int32_t)(INT32_MIN + dist)));
+        set_insts(unroll_pre, {n, wraps, BranchInst(wraps, bbs[loop.head], unroll_test)});
+    }
+    test_block(unroll_test, loop, factor, next, bbs[loop.head]);
+    guard->kind.data.branch.true_bb = unroll_pre;
+
+    std::vector<koopa_raw_basic_block_data_t *> res(bbs.begin(), bbs.begin() + loop.head);
+    res.push_back(unroll_pre);
+    if (unroll_test != unroll_pre)
+        res.push_back(unroll_test);
+    for (auto it = copies.rbegin(); it != copies.rend(); ++it)
+        res.insert(res.end(), it->begin(), it->end());
+    res.push_back(unroll_latch);
+    res.insert(res.end(), bbs.begin() + loop.head, bbs.end());
+    set_blocks(kfunc, res);
+    ++partial;
+    return true;
+}
+//
+// Merge a block ending in `jump` with its target when it is the target's only predecessor,
+// so the copies made by unrolling form straight-line code for `Simplifier`. Blocks in `keep`
+// (latches of loops left to the backend) are not merged into their predecessor.
+//
+static void merge_blocks(koopa_raw_function_data_t *kfunc, const std::set<koopa_raw_basic_block_t> &keep) {
+    std::vector<koopa_raw_basic_block_data_t *> bbs = block_list(kfunc);
+    std::map<koopa_raw_basic_block_t, int> preds;
+    for (auto kblk : bbs) {
+        koopa_raw_value_t term = (koopa_raw_value_t)kblk->insts.buffer[kblk->insts.len - 1];
+        if (term->kind.tag == KOOPA_RVT_BRANCH) {
+            ++preds[term->kind.data.branch.true_bb];
+            ++preds[term->kind.data.branch.false_bb];
+        }
+        else if (term->kind.tag == KOOPA_RVT_JUMP)
+            ++preds[term->kind.data.jump.target];
+    }
+    std::map<koopa_raw_basic_block_t, bool> merged;
+    for (auto kblk : bbs) {
+        if (merged[kblk])
+            continue;
+        for (;;) {
+            koopa_raw_value_t term = (koopa_raw_value_t)kblk->insts.buffer[kblk->insts.len - 1];
+            if (term->kind.tag != KOOPA_RVT_JUMP)
+                break;
+            koopa_raw_basic_block_data_t *next = (koopa_raw_basic_block_data_t *)term->kind.data.jump.target;
+            if (next == kblk || next == bbs.front() || preds[next] != 1 || keep.count(next))
+                break;
+            std::vector<const void *> insts(kblk->insts.buffer, kblk->insts.buffer + kblk->insts.len - 1);
+            insts.insert(insts.end(), next->insts.buffer, next->insts.buffer + next->insts.len);
+            set_insts(kblk, insts);
+            merged[next] = true;
+        }
+    }
+    std::vector<koopa_raw_basic_block_data_t *> res;
+    for (auto kblk : bbs)
+        if (!merged[kblk])
+            res.push_back(kblk);
+    if (res.size() != bbs.size())
+        set_blocks(kfunc, res);
+}
+
+void LoopUnroller::Run(const koopa_raw_program_t *raw) {
+    for (uint32_t i = 0; i < raw->funcs.len; ++i) {
+        koopa_raw_function_data_t *kfunc = (koopa_raw_function_data_t *)raw->funcs.buffer[i];
+        if (kfunc->bbs.len == 0)
+            continue;
+        // 从后往前处理, 前面的循环在 bbs 中的下标不变
+        std::vector<CountedLoop> loops = FindCountedLoops(kfunc);
+        bool changed = false;
+        std::set<koopa_raw_basic_block_t> keep;
+        for (auto it = loops.rbegin(); it != loops.rend(); ++it) {
+            VectorLoop vl;
+            if (keep_vector_loops && !FullyUnrolls(*it) && MatchVectorLoop(kfunc, *it, vl)) {
+                keep.insert((koopa_raw_basic_block_t)kfunc->bbs.buffer[it->latch]);
+                continue;
+            }
+            changed |= unroll(kfunc, *it);
+        }
+        if (changed)
+            merge_blocks(kfunc, keep);
+    }
+}
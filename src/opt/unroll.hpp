@@ -0,0 +1,64 @@
+#ifndef UNROLL_H
+#define UNROLL_H
+
+#include <map>
+#include <vector>
+
+#include <koopa.h>
+
+#include "opt/loop.hpp"
+
+// Unrolling of the counted loops (see `CountedLoop`) of the raw program.
+//
+// A loop with a constant trip count whose copies fit in `FULL_BUDGET` instructions is
+// replaced by that many copies of its body, one after another. Other loops get k copies of
+// their body (at most `MAX_FACTOR`, at least 2, within `PARTIAL_BUDGET` instructions) in
+// front of them:
+//
+//     pre:      ...; br %guard, unroll_pre, exit
+//     unroll_pre: br i < n - (k-1)*s, body_1, head       (at least k iterations left)
+//     body_1 .. body_k                                     (no test between the copies)
+//     unroll_latch: br i < n - (k-1)*s, body_1, latch
+//     head .. latch                                        (the original loop, remainder)
+//
+// If n is a variable, `unroll_pre` first sends n < INT32_MIN + (k-1)*s, where the bound
+// would wrap, to `head`, and the test moves to a block `unroll_test` after it.
+//
+// Then a block ending in a jump is merged with its target if it is the only way there, so
+// the copies are one block for a second run of `Simplifier`.
+// Only the innermost loops are counted loops, so the nests stay intact. With
+// `keep_vector_loops`, loops the backend vectorizes (`MatchVectorLoop`) are only unrolled
+// fully, and their latch is not merged, so the backend still finds them.
+//
+// `-fprofile-use` does not bias the factors toward hot loops yet: the block counts of a
+// profile are indexed by the blocks the backend sees, after unrolling in the `-instrument`
+// build, so unrolling differently from that build would make every profile of the function
+// mismatch and lose its block layout. That needs counts keyed by something unrolling keeps.
+class LoopUnroller {
+    static const size_t FULL_BUDGET = 128;
+    static const size_t PARTIAL_BUDGET = 64;
+    static const int MAX_FACTOR = 4;
+
+    // Copies of the body made by `clone_body`.
+    std::map<koopa_raw_value_t, koopa_raw_value_t> vmap;
+    std::map<koopa_raw_basic_block_t, koopa_raw_basic_block_t> bmap;
+
+    std::vector<koopa_raw_basic_block_data_t *> clone_body(koopa_raw_function_t kfunc, const CountedLoop &loop,
+                                                           koopa_raw_basic_block_t next);
+    void test_block(koopa_raw_basic_block_data_t *kblk, const CountedLoop &loop, int factor,
+                    koopa_raw_basic_block_t more, koopa_raw_basic_block_t less);
+    bool unroll(koopa_raw_function_data_t *kfunc, const CountedLoop &loop);
+
+public:
+    // Whether `loop` is small enough to be fully unrolled.
+    static bool FullyUnrolls(const CountedLoop &loop);
+
+    // Leave the loops `MatchVectorLoop` accepts alone unless they are fully unrolled (-march
+    // with the V extension).
+    bool keep_vector_loops = false;
+    // Loops fully and partially unrolled, over all runs.
+    size_t full = 0, partial = 0;
+
+    void Run(const koopa_raw_program_t *raw);
+};
+#endif
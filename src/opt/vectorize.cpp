@@ -0,0 +1,226 @@
+#include "opt/vectorize.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "opt/alias.hpp"
+#include "opt/ir_util.hpp"
+
+static bool scalar_var(koopa_raw_value_t kval) {
+    return (kval->kind.tag == KOOPA_RVT_ALLOC || kval->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) &&
+           kval->ty->data.pointer.base->tag != KOOPA_RTT_ARRAY;
+}
+
+static bool vector_op(koopa_raw_binary_op_t op) {
+    switch (op) {
+    case KOOPA_RBO_ADD: case KOOPA_RBO_SUB: case KOOPA_RBO_MUL: case KOOPA_RBO_DIV: case KOOPA_RBO_MOD:
+    case KOOPA_RBO_AND: case KOOPA_RBO_OR: case KOOPA_RBO_XOR:
+    case KOOPA_RBO_SHL: case KOOPA_RBO_SHR: case KOOPA_RBO_SAR:
+    case KOOPA_RBO_EQ: case KOOPA_RBO_NOT_EQ: case KOOPA_RBO_LT: case KOOPA_RBO_LE:
+    case KOOPA_RBO_GT: case KOOPA_RBO_GE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool MatchVectorLoop(koopa_raw_function_t kfunc, const CountedLoop &loop, VectorLoop &res) {
+    if (loop.step != 1 || loop.head != loop.incr || loop.incr + 1 != loop.latch || loop.size > VectorLoop::MAX_SIZE)
+        return false;
+    koopa_raw_basic_block_t body = (koopa_raw_basic_block_t)kfunc->bbs.buffer[loop.head];
+    res = VectorLoop();
+    res.loop = loop;
+    res.body = body;
+    std::map<koopa_raw_value_t, VectorLoop::Kind> &kind = res.kind;
+    std::map<koopa_raw_value_t, int64_t> &coef = res.coef;
+
+    // 除了 i, 循环只能存一个标量变量, 就是求和的变量
+    for (uint32_t j = 0; j < body->insts.len; ++j) {
+        koopa_raw_value_t kval = (koopa_raw_value_t)body->insts.buffer[j];
+        if (kval->kind.tag != KOOPA_RVT_STORE)
+            continue;
+        koopa_raw_value_t dest = kval->kind.data.store.dest;
+        if (dest != loop.iv && scalar_var(dest)) {
+            if (res.sum)
+                return false;
+            res.sum = dest;
+        }
+    }
+
+    // 循环外的值都是 SCALAR; 线性的 SCALAR 用作 VECTOR 时要占一个寄存器
+    size_t vectors = 0;
+    auto operand = [&](koopa_raw_value_t kval, VectorLoop::Kind &k) {
+        auto it = kind.find(kval);
+        k = it == kind.end() ? VectorLoop::SCALAR : it->second;
+        if (k == VectorLoop::SCALAR && coef[kval] != 0)
+            ++vectors;
+        return k == VectorLoop::SCALAR || k == VectorLoop::VECTOR;
+    };
+    koopa_raw_value_t sum_load = nullptr, sum_add = nullptr;
+    bool incremented = false, stored = false;
+    std::vector<koopa_raw_value_t> loads, stores;
+    for (uint32_t j = 0; j < body->insts.len; ++j) {
+        koopa_raw_value_t kval = (koopa_raw_value_t)body->insts.buffer[j];
+        const koopa_raw_value_kind_t &k = kval->kind;
+        VectorLoop::Kind lk, rk;
+        switch (k.tag) {
+        case KOOPA_RVT_LOAD: {
+            koopa_raw_value_t src = k.data.load.src;
+            if (src == loop.iv) {
+                // 自增之后的 load @i 是下一轮的 i
+                if (incremented)
+                    return false;
+                kind[kval] = VectorLoop::SCALAR;
+                coef[kval] = 1;
+            }
+            else if (src == res.sum) {
+                if (sum_load)
+                    return false;
+                sum_load = kval;
+                kind[kval] = VectorLoop::SKIP;
+            }
+            else if (scalar_var(src))
+                kind[kval] = VectorLoop::SCALAR;
+            else if (kind.count(src) && kind[src] == VectorLoop::ADDRESS && !stored) {
+                kind[kval] = VectorLoop::VECTOR;
+                loads.push_back(src);
+                ++vectors;
+            }
+            else
+                return false;
+            break;
+        }
+        case KOOPA_RVT_GET_ELEM_PTR:
+        case KOOPA_RVT_GET_PTR: {
+            bool gep = k.tag == KOOPA_RVT_GET_ELEM_PTR;
+            koopa_raw_value_t src = gep ? k.data.get_elem_ptr.src : k.data.get_ptr.src;
+            koopa_raw_value_t index = gep ? k.data.get_elem_ptr.index : k.data.get_ptr.index;
+            if (!operand(src, lk) || lk != VectorLoop::SCALAR || coef[src] != 0 ||
+                !operand(index, rk) || rk != VectorLoop::SCALAR)
+                return false;
+            vectors -= coef[index] != 0;
+            if (coef[index] == 0)
+                kind[kval] = VectorLoop::SCALAR;
+            else if (coef[index] == 1 && kval->ty->data.pointer.base->tag == KOOPA_RTT_INT32)
+                kind[kval] = VectorLoop::ADDRESS;
+            else
+                return false;
+            break;
+        }
+        case KOOPA_RVT_BINARY: {
+            koopa_raw_value_t lhs = k.data.binary.lhs, rhs = k.data.binary.rhs;
+            if (sum_load && (lhs == sum_load || rhs == sum_load)) {
+                koopa_raw_value_t x = lhs == sum_load ? rhs : lhs;
+                if (k.data.binary.op != KOOPA_RBO_ADD || sum_add || x == sum_load || !operand(x, lk))
+                    return false;
+                sum_add = kval;
+                res.summand = x;
+                kind[kval] = VectorLoop::SKIP;
+                break;
+            }
+            if (!operand(lhs, lk) || !operand(rhs, rk))
+                return false;
+            if (lk == VectorLoop::SCALAR && rk == VectorLoop::SCALAR) {
+                // 仍是 r + coef * i 时就是 SCALAR, 不用占寄存器
+                int64_t cl = coef[lhs], cr = coef[rhs], c = 0;
+                bool linear = cl == 0 && cr == 0;
+                switch (k.data.binary.op) {
+                case KOOPA_RBO_ADD:
+                    c = cl + cr;
+                    linear = true;
+                    break;
+                case KOOPA_RBO_SUB:
+                    c = cl - cr;
+                    linear = true;
+                    break;
+                case KOOPA_RBO_MUL:
+                    if (is_const(rhs) || is_const(lhs)) {
+                        c = is_const(rhs) ? cl * const_value(rhs) : cr * const_value(lhs);
+                        linear = true;
+                    }
+                    break;
+                default:
+                    break;
+                }
+                if (linear && std::llabs(c) <= INT32_MAX) {
+                    vectors -= (cl != 0) + (cr != 0);
+                    kind[kval] = VectorLoop::SCALAR;
+                    coef[kval] = c;
+                    break;
+                }
+            }
+            if (!vector_op(k.data.binary.op))
+                return false;
+            kind[kval] = VectorLoop::VECTOR;
+            ++vectors;
+            break;
+        }
+        case KOOPA_RVT_STORE: {
+            koopa_raw_value_t value = k.data.store.value, dest = k.data.store.dest;
+            if (dest == loop.iv) {
+                if (incremented)
+                    return false;
+                incremented = true;
+                kind[kval] = VectorLoop::SKIP;
+            }
+            else if (dest == res.sum) {
+                if (!sum_add || value != sum_add)
+                    return false;
+                kind[kval] = VectorLoop::REDUCE;
+            }
+            else if (kind.count(dest) && kind[dest] == VectorLoop::ADDRESS && operand(value, lk)) {
+                kind[kval] = VectorLoop::STORE;
+                stores.push_back(dest);
+                stored = true;
+            }
+            else
+                return false;
+            break;
+        }
+        case KOOPA_RVT_JUMP:
+            kind[kval] = VectorLoop::SKIP;
+            break;
+        default:
+            return false;
+        }
+    }
+    if (stores.empty() && !res.sum)
+        return false;
+    if (res.sum && (!sum_add || !kind.count(sum_add)))
+        return false;
+    size_t addresses = std::count_if(kind.begin(), kind.end(), [](const std::pair<const koopa_raw_value_t, VectorLoop::Kind> &p) {
+        return p.second == VectorLoop::ADDRESS;
+    });
+    if (vectors > VectorLoop::MAX_VECTOR || addresses > VectorLoop::MAX_ADDRESS)
+        return false;
+
+    // 向量路径只在循环结束时更新 i 和求和的变量, 循环体的值不能在别处用到
+    for (uint32_t b = 0; b < kfunc->bbs.len; ++b) {
+        if (b == loop.head)
+            continue;
+        koopa_raw_basic_block_t kblk = (koopa_raw_basic_block_t)kfunc->bbs.buffer[b];
+        for (uint32_t j = 0; j < kblk->insts.len; ++j) {
+            bool used = false;
+            for_each_operand((koopa_raw_value_data *)kblk->insts.buffer[j], [&](koopa_raw_value_t &op) {
+                used |= kind.count(op) != 0;
+            });
+            if (used)
+                return false;
+        }
+    }
+
+    // 写入的对象互不重叠, 可能重叠的读写在运行时检查
+    AliasAnalysis alias(kfunc);
+    for (size_t x = 0; x < stores.size(); ++x)
+        for (size_t y = x + 1; y < stores.size(); ++y)
+            if (alias.Alias(stores[x], stores[y]) != AliasAnalysis::NO_ALIAS)
+                return false;
+    for (koopa_raw_value_t s : stores)
+        for (koopa_raw_value_t l : loads) {
+            std::pair<koopa_raw_value_t, koopa_raw_value_t> pair(s, l);
+            if (s != l && alias.Alias(s, l) != AliasAnalysis::NO_ALIAS &&
+                std::find(res.overlap.begin(), res.overlap.end(), pair) == res.overlap.end())
+                res.overlap.push_back(pair);
+        }
+    return res.overlap.size() <= VectorLoop::MAX_OVERLAP;
+}
@@ -0,0 +1,57 @@
+#ifndef VECTORIZE_H
+#define VECTORIZE_H
+
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <koopa.h>
+
+#include "opt/loop.hpp"
+
+// Counted loops (see `CountedLoop`) the backend runs with the RISC-V vector extension when
+// it targets `-march=rv32gcv`: element-wise loops and sums over int arrays, like
+//
+//     while (i < n) { c[i] = a[i] * k + b[i + 1]; s = s + a[i]; i = i + 1; }
+//
+// The body is one block and the step is 1. Every instruction of the body is one of
+//
+//     SCALAR   the same in every iteration, or `r + coef * i` with `r` the same in every
+//              iteration; computed once, for the first i
+//     ADDRESS  getelemptr/getptr of an int at index `i + r` from a SCALAR pointer
+//     VECTOR   a load from an ADDRESS, or a binary operation of VECTOR and SCALAR values
+//              (all of them SCALAR if it is not `r + coef * i`), one lane per iteration
+//     STORE    of a VECTOR or SCALAR value to an ADDRESS
+//     REDUCE   `store add(load @s, %x), @s` for a scalar variable `@s`, at most one; the
+//              load and the add are SKIP
+//     SKIP     the increment of i and the jump to the latch
+//
+// so there are no calls and no other stores. All loads of array elements come before the
+// first STORE, the stores go to different objects which do not alias each other, and a
+// load which may alias a store (the same object, a parameter and another parameter or a
+// global) is checked at run time: the lanes of a strip load before they store, which is
+// wrong if the load reads the element an earlier lane stores to, `0 < S - L < vlenb`.
+struct VectorLoop {
+    enum Kind { SCALAR, ADDRESS, VECTOR, STORE, REDUCE, SKIP };
+
+    CountedLoop loop;
+    koopa_raw_basic_block_t body;
+    std::map<koopa_raw_value_t, Kind> kind;
+    // `coef` of the SCALAR values which are `r + coef * i`, 0 for the others.
+    std::map<koopa_raw_value_t, int64_t> coef;
+    // Variable and summand of the reduction, nullptr if there is none.
+    koopa_raw_value_t sum = nullptr, summand = nullptr;
+    // ADDRESS values stored to and loaded from which are checked for overlap, S and L.
+    std::vector<std::pair<koopa_raw_value_t, koopa_raw_value_t>> overlap;
+
+    // Limits of the registers the backend has for a loop.
+    static const size_t MAX_ADDRESS = 9;
+    static const size_t MAX_VECTOR = 29;
+    static const size_t MAX_OVERLAP = 8;
+    static const size_t MAX_SIZE = 64;
+};
+
+// Whether the body of `loop` in `kfunc` fits `VectorLoop`, filling in `res`.
+bool MatchVectorLoop(koopa_raw_function_t kfunc, const CountedLoop &loop, VectorLoop &res);
+#endif
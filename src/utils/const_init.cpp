@@ -0,0 +1,68 @@
+#include "utils/const_init.hpp"
+
+#include "utils/koopa_util.hpp"
+
+std::map<std::string, ConstInit> ConstInit::table;
+
+void ConstInit::BuildRuns() {
+    runs.clear();
+    size_t n = data.size();
+    for (size_t i = 0; i < n; ) {
+        if (data[i] == 0) {
+            i++;
+            continue;
+        }
+        size_t begin = i;
+        while (i < n && data[i] != 0)
+            i++;
+        runs.emplace_back(begin, i);
+    }
+}
+
+koopa_raw_value_t ConstInit::Materialize(koopa_raw_type_t ty, size_t &pos) const {
+    if (ty->tag != KOOPA_RTT_ARRAY)
+        return make_koopa_interger(data[pos++]);
+
+    size_t size = 1;
+    for (koopa_raw_type_t t = ty; t->tag == KOOPA_RTT_ARRAY; t = t->data.array.base)
+        size *= t->data.array.len;
+    bool zero = true;
+    for (size_t i = pos; i < pos + size && zero; ++i)
+        zero = data[i] == 0;
+    if (zero) {
+        pos += size;
+        return ZeroInit((koopa_raw_type_kind *)ty);
+    }
+    std::vector<const void *> elems;
+    for (size_t i = 0; i < ty->data.array.len; ++i)
+        elems.push_back(Materialize(ty->data.array.base, pos));
+    koopa_raw_value_data *res = Init(ty, nullptr, empty_koopa_raw_slice(KOOPA_RSIK_VALUE),
+        make_koopa_raw_value_kind(KOOPA_RVT_AGGREGATE));
+    res->kind.data.aggregate.elems = make_koopa_raw_slice(elems, KOOPA_RSIK_VALUE);
+    return res;
+}
+
+ConstInit &ConstInit::Add(const std::string &name) {
+    ConstInit &res = table[name];
+    res.data.clear();
+    res.runs.clear();
+    return res;
+}
+
+const ConstInit *ConstInit::Find(const char *name) {
+    if (!name || table.empty())
+        return nullptr;
+    auto it = table.find(name);
+    return it == table.end() ? nullptr : &it->second;
+}
+
+void ConstInit::MaterializeAll(const koopa_raw_program_t *raw) {
+    for (uint32_t i = 0; i < raw->values.len; ++i) {
+        koopa_raw_value_data *kval = (koopa_raw_value_data *)raw->values.buffer[i];
+        const ConstInit *init = Find(kval->name);
+        if (!init)
+            continue;
+        size_t pos = 0;
+        kval->kind.data.global_alloc.init = init->Materialize(kval->ty->data.pointer.base, pos);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef CONST_INIT_H
+#define CONST_INIT_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <koopa.h>
+
+// Initializer of a global array, kept as a dense `int32` buffer plus its nonzero runs
+// instead of one `koopa_raw_value_data` per element.
+//
+// The global itself is built with a `zeroinit` and looked up here by name: the backend and
+// the interpreter read `data`/`runs` directly, and the Koopa aggregate is only built by
+// `MaterializeAll` when `-koopa` writes the IR as text.
+class ConstInit {
+    static std::map<std::string, ConstInit> table;
+
+public:
+    std::vector<int32_t> data;
+    // [begin, end) of every run of nonzero elements, in order.
+    std::vector<std::pair<size_t, size_t>> runs;
+
+    // Compute `runs` from `data`.
+    void BuildRuns();
+    // Nested aggregate of type `ty` for `data[pos...]`, all-zero parts become `zeroinit`.
+    koopa_raw_value_t Materialize(koopa_raw_type_t ty, size_t &pos) const;
+
+    // The initializer of global `name` (with '@'), created empty.
+    static ConstInit &Add(const std::string &name);
+    // The initializer of global `name` (with '@'), nullptr if it has none.
+    static const ConstInit *Find(const char *name);
+    // Replace the `zeroinit` of every global with an initializer by its aggregate.
+    static void MaterializeAll(const koopa_raw_program_t *raw);
+};
+#endif
@@ -0,0 +1,335 @@
+#include "utils/koopa_interp.hpp"
+#include "utils/const_init.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+// Memory grows on demand up to this many bytes (globals + stack).
+static const uint32_t MEM_LIMIT = 1u << 30;
+// Activations of functions, for functions without allocs which never grow the stack.
+static const size_t MAX_CALL_DEPTH = 1u << 22;
+
+uint32_t KoopaInterpreter::type_size(koopa_raw_type_t ty) {
+    switch (ty->tag) {
+        case KOOPA_RTT_ARRAY:
+            return type_size(ty->data.array.base) * ty->data.array.len;
+        case KOOPA_RTT_POINTER:
+        case KOOPA_RTT_INT32:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+void KoopaInterpreter::error(const std::string &msg) const {
+    std::cerr << "interp error: " << msg << std::endl;
+    exit(1);
+}
+
+//
+// The word at byte address `addr`. Address 0 is the null pointer and never valid.
+//
+int32_t &KoopaInterpreter::word(int32_t addr) {
+    uint32_t a = (uint32_t)addr;
+    if (a == 0 || a % 4 != 0 || a / 4 >= mem.size())
+        error("invalid memory access at address " + std::to_string(a));
+    return mem[a / 4];
+}
+
+void KoopaInterpreter::init_global(uint32_t addr, koopa_raw_value_t init) {
+    switch (init->kind.tag) {
+        case KOOPA_RVT_INTEGER:
+            word(addr) = init->kind.data.integer.value;
+            break;
+        case KOOPA_RVT_AGGREGATE: {
+            const koopa_raw_slice_t &elems = init->kind.data.aggregate.elems;
+            for (uint32_t i = 0; i < elems.len; ++i) {
+                koopa_raw_value_t e = (koopa_raw_value_t)elems.buffer[i];
+                init_global(addr, e);
+                addr += type_size(e->ty);
+            }
+            break;
+        }
+        default:    // zeroinit, undef: memory is already zero
+            break;
+    }
+}
+
+int32_t KoopaInterpreter::operand(Frame &f, koopa_raw_value_t kval) {
+    switch (kval->kind.tag) {
+        case KOOPA_RVT_INTEGER:
+            return kval->kind.data.integer.value;
+        case KOOPA_RVT_ZERO_INIT:
+        case KOOPA_RVT_UNDEF:
+            return 0;
+        case KOOPA_RVT_FUNC_ARG_REF:
+            if (kval->kind.data.func_arg_ref.index >= f.args.size())
+                error("missing function argument");
+            return f.args[kval->kind.data.func_arg_ref.index];
+        case KOOPA_RVT_GLOBAL_ALLOC:
+            return global_addr.at(kval);
+        default: {
+            auto it = f.vals.find(kval);
+            if (it == f.vals.end())
+                error("use of a value before its definition");
+            return it->second;
+        }
+    }
+}
+
+//
+// Integer semantics of RV32IM: wrapping arithmetic, and division by zero or overflow
+// gives the results of `div`/`rem` instead of trapping.
+//
+int32_t KoopaInterpreter::binary(koopa_raw_binary_op_t op, int32_t lhs, int32_t rhs) {
+    uint32_t ul = (uint32_t)lhs, ur = (uint32_t)rhs;
+    switch (op) {
+        case KOOPA_RBO_NOT_EQ: return lhs != rhs;
+        case KOOPA_RBO_EQ: return lhs == rhs;
+        case KOOPA_RBO_GT: return lhs > rhs;
+        case KOOPA_RBO_LT: return lhs < rhs;
+        case KOOPA_RBO_GE: return lhs >= rhs;
+        case KOOPA_RBO_LE: return lhs <= rhs;
+        case KOOPA_RBO_ADD: return (int32_t)(ul + ur);
+        case KOOPA_RBO_SUB: return (int32_t)(ul - ur);
+        case KOOPA_RBO_MUL: return (int32_t)(ul * ur);
+        case KOOPA_RBO_DIV:
+            if (rhs == 0)
+                return -1;
+            if (lhs == INT_MIN && rhs == -1)
+                return INT_MIN;
+            return lhs / rhs;
+        case KOOPA_RBO_MOD:
+            if (rhs == 0)
+                return lhs;
+            if (lhs == INT_MIN && rhs == -1)
+                return 0;
+            return lhs % rhs;
+        case KOOPA_RBO_AND: return lhs & rhs;
+        case KOOPA_RBO_OR: return lhs | rhs;
+        case KOOPA_RBO_XOR: return lhs ^ rhs;
+        case KOOPA_RBO_SHL: return (int32_t)(ul << (ur & 31));
+        case KOOPA_RBO_SHR: return (int32_t)(ul >> (ur & 31));
+        case KOOPA_RBO_SAR: return lhs >> (ur & 31);
+    }
+    return 0;
+}
+
+//
+// The SysY runtime, i.e. the functions declared by `CompUnitAST::add_lib_funcs`.
+//
+int32_t KoopaInterpreter::call_native(koopa_raw_function_t kfunc, const std::vector<int32_t> &args) {
+    native_calls++;
+    const char *name = kfunc->name + 1;
+    int x = 0;
+    if (strcmp(name, "getint") == 0) {
+        if (fscanf(in, "%d", &x) != 1)
+            x = 0;
+        return x;
+    }
+    if (strcmp(name, "getch") == 0)
+        return fgetc(in);
+    if (strcmp(name, "getarray") == 0) {
+        int n = 0;
+        if (fscanf(in, "%d", &n) != 1)
+            n = 0;
+        for (int i = 0; i < n; ++i) {
+            if (fscanf(in, "%d", &x) != 1)
+                x = 0;
+            word(args[0] + 4 * i) = x;
+        }
+        return n;
+    }
+    if (strcmp(name, "putint") == 0)
+        fprintf(out, "%d", args[0]);
+    else if (strcmp(name, "putch") == 0)
+        fputc(args[0], out);
+    else if (strcmp(name, "putarray") == 0) {
+        fprintf(out, "%d:", args[0]);
+        for (int i = 0; i < args[0]; ++i)
+            fprintf(out, " %d", word(args[1] + 4 * i));
+        fputc('\n', out);
+    }
+    else if (strcmp(name, "__sysy_memset32") == 0) {
+        for (int i = 0; i < args[2]; ++i)
+            word(args[0] + 4 * i) = args[1];
+    }
+    else if (strcmp(name, "__sysy_memcpy32") == 0) {
+        for (int i = 0; i < args[2]; ++i)
+            word(args[0] + 4 * i) = word(args[1] + 4 * i);
+    }
+    else if (strcmp(name, "starttime") != 0 && strcmp(name, "stoptime") != 0)
+        error(std::string("call to undefined function ") + kfunc->name);
+    return 0;
+}
+
+//
+// Push an activation of `kfunc` onto `frames`, with a slot on the stack for every `alloc`.
+//
+void KoopaInterpreter::enter(std::vector<Frame> &frames, koopa_raw_function_t kfunc, std::vector<int32_t> &&args) {
+    if (frames.size() >= MAX_CALL_DEPTH)
+        error("call stack overflow");
+    frames.emplace_back();
+    Frame &f = frames.back();
+    f.func = kfunc;
+    f.args = std::move(args);
+    // Every `alloc` owns one slot for the whole activation, like a stack frame slot.
+    f.frame_base = stack_top;
+    for (uint32_t i = 0; i < kfunc->bbs.len; ++i) {
+        koopa_raw_basic_block_t kblk = (koopa_raw_basic_block_t)kfunc->bbs.buffer[i];
+        for (uint32_t j = 0; j < kblk->insts.len; ++j) {
+            koopa_raw_value_t kval = (koopa_raw_value_t)kblk->insts.buffer[j];
+            if (kval->kind.tag != KOOPA_RVT_ALLOC)
+                continue;
+            f.vals[kval] = stack_top;
+            stack_top += (type_size(kval->ty->data.pointer.base) + 3) / 4 * 4;
+        }
+    }
+    if (stack_top >= MEM_LIMIT)
+        error("stack overflow");
+    if (mem.size() < stack_top / 4)
+        mem.resize(stack_top / 4 + (stack_top / 4) / 2);
+    memset(&mem[f.frame_base / 4], 0, stack_top - f.frame_base);
+    f.block = (koopa_raw_basic_block_t)kfunc->bbs.buffer[0];
+    f.pos = 0;
+    block_count++;
+}
+
+//
+// Run `kfunc` to its return. Calls push a frame on an explicit stack instead of recursing,
+// so deep recursion in the program is bounded by `MEM_LIMIT`, not by the native stack.
+//
+int32_t KoopaInterpreter::exec_func(koopa_raw_function_t kfunc, std::vector<int32_t> &&args) {
+    std::vector<Frame> frames;
+    enter(frames, kfunc, std::move(args));
+    for (;;) {
+        Frame &f = frames.back();
+        if (f.pos >= f.block->insts.len)
+            error(std::string("basic block without terminator in ") + f.func->name);
+        koopa_raw_value_t kval = (koopa_raw_value_t)f.block->insts.buffer[f.pos++];
+        const koopa_raw_value_kind_t &k = kval->kind;
+        tag_count[k.tag]++;
+        koopa_raw_basic_block_t next = nullptr;
+        switch (k.tag) {
+            case KOOPA_RVT_ALLOC:
+                break;
+            case KOOPA_RVT_LOAD:
+                f.vals[kval] = word(operand(f, k.data.load.src));
+                break;
+            case KOOPA_RVT_STORE:
+                word(operand(f, k.data.store.dest)) = operand(f, k.data.store.value);
+                break;
+            case KOOPA_RVT_GET_PTR:
+                f.vals[kval] = operand(f, k.data.get_ptr.src)
+                    + operand(f, k.data.get_ptr.index) * (int32_t)type_size(k.data.get_ptr.src->ty->data.pointer.base);
+                break;
+            case KOOPA_RVT_GET_ELEM_PTR:
+                f.vals[kval] = operand(f, k.data.get_elem_ptr.src)
+                    + operand(f, k.data.get_elem_ptr.index)
+                    * (int32_t)type_size(k.data.get_elem_ptr.src->ty->data.pointer.base->data.array.base);
+                break;
+            case KOOPA_RVT_BINARY:
+                binary_count[k.data.binary.op]++;
+                f.vals[kval] = binary(k.data.binary.op, operand(f, k.data.binary.lhs), operand(f, k.data.binary.rhs));
+                break;
+            case KOOPA_RVT_BRANCH:
+                if (operand(f, k.data.branch.cond)) {
+                    branch_taken++;
+                    next = k.data.branch.true_bb;
+                }
+                else
+                    next = k.data.branch.false_bb;
+                break;
+            case KOOPA_RVT_JUMP:
+                next = k.data.jump.target;
+                break;
+            case KOOPA_RVT_CALL: {
+                std::vector<int32_t> call_args;
+                for (uint32_t i = 0; i < k.data.call.args.len; ++i)
+                    call_args.push_back(operand(f, (koopa_raw_value_t)k.data.call.args.buffer[i]));
+                if (k.data.call.callee->bbs.len == 0)
+                    f.vals[kval] = call_native(k.data.call.callee, call_args);
+                else
+                    enter(frames, k.data.call.callee, std::move(call_args));
+                break;
+            }
+            case KOOPA_RVT_RETURN: {
+                int32_t res = k.data.ret.value ? operand(f, k.data.ret.value) : 0;
+                stack_top = f.frame_base;
+                frames.pop_back();
+                if (frames.empty())
+                    return res;
+                // 调用者停在 call 之后
+                Frame &caller = frames.back();
+                caller.vals[(koopa_raw_value_t)caller.block->insts.buffer[caller.pos - 1]] = res;
+                break;
+            }
+            default:
+                error("unexpected value in basic block");
+        }
+        if (next) {
+            f.block = next;
+            f.pos = 0;
+            block_count++;
+        }
+    }
+}
+
+int KoopaInterpreter::run(const koopa_raw_program_t *raw) {
+    // Address 0 stays unused so that null pointers fault.
+    uint32_t top = 4;
+    for (uint32_t i = 0; i < raw->values.len; ++i) {
+        koopa_raw_value_t kval = (koopa_raw_value_t)raw->values.buffer[i];
+        global_addr[kval] = top;
+        top += (type_size(kval->ty->data.pointer.base) + 3) / 4 * 4;
+    }
+    mem.assign(top / 4 + (1 << 16), 0);
+    for (uint32_t i = 0; i < raw->values.len; ++i) {
+        koopa_raw_value_t kval = (koopa_raw_value_t)raw->values.buffer[i];
+        if (const ConstInit *init = ConstInit::Find(kval->name))
+            std::copy(init->data.begin(), init->data.end(), mem.begin() + global_addr[kval] / 4);
+        else
+            init_global(global_addr[kval], kval->kind.data.global_alloc.init);
+    }
+    stack_top = top;
+
+    for (uint32_t i = 0; i < raw->funcs.len; ++i) {
+        koopa_raw_function_t kfunc = (koopa_raw_function_t)raw->funcs.buffer[i];
+        if (strcmp(kfunc->name, "@main") == 0) {
+            exit_code = exec_func(kfunc, std::vector<int32_t>());
+            fflush(out);
+            return exit_code;
+        }
+    }
+    error("no @main function");
+}
+
+void KoopaInterpreter::report(std::ostream &os) const {
+    static const char *tag_name[KOOPA_RVT_RETURN + 1] = {
+        "integer", "zeroinit", "undef", "aggregate", "func_arg_ref", "block_arg_ref", "alloc", "global_alloc",
+        "load", "store", "getptr", "getelemptr", "binary", "br", "jump", "call", "ret"
+    };
+    static const char *op_name[KOOPA_RBO_SAR + 1] = {
+        "ne", "eq", "gt", "lt", "ge", "le", "add", "sub", "mul", "div", "mod", "and", "or", "xor", "shl", "shr", "sar"
+    };
+    uint64_t total = 0;
+    for (int t = KOOPA_RVT_ALLOC; t <= KOOPA_RVT_RETURN; ++t)
+        total += tag_count[t];
+
+    os << "exit code: " << exit_code << std::endl;
+    os << "dynamic instructions: " << total << std::endl;
+    for (int t = KOOPA_RVT_ALLOC; t <= KOOPA_RVT_RETURN; ++t)
+        if (t != KOOPA_RVT_GLOBAL_ALLOC)
+            os << "  " << tag_name[t] << ": " << tag_count[t] << std::endl;
+    os << "memory ops: " << tag_count[KOOPA_RVT_LOAD] + tag_count[KOOPA_RVT_STORE] << std::endl;
+    os << "branches taken: " << branch_taken << " / " << tag_count[KOOPA_RVT_BRANCH] << std::endl;
+    os << "basic blocks executed: " << block_count << std::endl;
+    os << "runtime library calls: " << native_calls << std::endl;
+    os << "binary operators:" << std::endl;
+    for (int op = 0; op <= KOOPA_RBO_SAR; ++op)
+        if (binary_count[op])
+            os << "  " << op_name[op] << ": " << binary_count[op] << std::endl;
+}
@@ -0,0 +1,63 @@
+#ifndef KOOPA_INTERP_H
+#define KOOPA_INTERP_H
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <koopa.h>
+
+// Interpreter of a `koopa_raw_program_t`, used by the `-interp` mode.
+//
+// Runs `@main` with the SysY runtime (`@getint`, `@putint`, ...) implemented natively and
+// counts every executed instruction by `koopa_raw_value_tag_t` (and binaries by operator),
+// so it serves as a local oracle for both the output and the dynamic cost of the IR.
+//
+// Memory is a flat array of 32-bit words addressed in bytes, laid out like the RISC-V
+// backend does: the same type sizes, globals first, then a stack of frames.
+class KoopaInterpreter {
+    // One activation of a function: values computed in it, its stack slots from `frame_base`,
+    // and the instruction `pos` of `block` it runs next.
+    struct Frame {
+        koopa_raw_function_t func;
+        std::vector<int32_t> args;
+        std::unordered_map<koopa_raw_value_t, int32_t> vals;
+        uint32_t frame_base;
+        koopa_raw_basic_block_t block;
+        uint32_t pos;
+    };
+
+    std::vector<int32_t> mem;
+    uint32_t stack_top;
+    std::unordered_map<koopa_raw_value_t, int32_t> global_addr;
+    FILE *in;
+    FILE *out;
+
+    // Dynamic counts.
+    uint64_t tag_count[KOOPA_RVT_RETURN + 1] = {};
+    uint64_t binary_count[KOOPA_RBO_SAR + 1] = {};
+    uint64_t branch_taken = 0, block_count = 0, native_calls = 0;
+    int exit_code = 0;
+
+    static uint32_t type_size(koopa_raw_type_t ty);
+    [[noreturn]] void error(const std::string &msg) const;
+    int32_t &word(int32_t addr);
+    void init_global(uint32_t addr, koopa_raw_value_t init);
+    int32_t operand(Frame &f, koopa_raw_value_t kval);
+    static int32_t binary(koopa_raw_binary_op_t op, int32_t lhs, int32_t rhs);
+    int32_t call_native(koopa_raw_function_t kfunc, const std::vector<int32_t> &args);
+    void enter(std::vector<Frame> &frames, koopa_raw_function_t kfunc, std::vector<int32_t> &&args);
+    int32_t exec_func(koopa_raw_function_t kfunc, std::vector<int32_t> &&args);
+
+public:
+    // `_in` feeds `@getint`/`@getch`/`@getarray`, `_out` receives the `@put*` output.
+    KoopaInterpreter(FILE *_in, FILE *_out) : in(_in), out(_out) {}
+    // Run `@main` of `raw`, returns its return value.
+    int run(const koopa_raw_program_t *raw);
+    // Write the dynamic counts of the last run.
+    void report(std::ostream &os) const;
+};
+#endif
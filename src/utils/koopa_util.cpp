@@ -3,6 +3,28 @@
 #include <cassert>
 #include <cstring>
 
+#include "utils/mem_report.hpp"
+
+koopa_raw_value_data *new_koopa_raw_value() {
+    MemReport::Count(MemReport::RawValue, sizeof(koopa_raw_value_data));
+    return new koopa_raw_value_data();
+}
+
+koopa_raw_type_kind *new_koopa_raw_type() {
+    MemReport::Count(MemReport::RawType, sizeof(koopa_raw_type_kind));
+    return new koopa_raw_type_kind();
+}
+
+koopa_raw_basic_block_data_t *new_koopa_raw_basic_block() {
+    MemReport::Count(MemReport::RawBasicBlock, sizeof(koopa_raw_basic_block_data_t));
+    return new koopa_raw_basic_block_data_t();
+}
+
+koopa_raw_function_data_t *new_koopa_raw_function() {
+    MemReport::Count(MemReport::RawFunction, sizeof(koopa_raw_function_data_t));
+    return new koopa_raw_function_data_t();
+}
+
 /// Parameter should be a kind (`koopa_raw_slice_item_kind_t`).
 ///
 /// Returns `koopa_raw_slice_t` with nullptr as buffer and len=0.
@@ -19,6 +41,7 @@ koopa_raw_slice_t empty_koopa_raw_slice(koopa_raw_slice_item_kind_t kind) {
 /// Returns `koopa_raw_slice_t` with the given vector as buffer and len=vec.size().
 koopa_raw_slice_t make_koopa_raw_slice(const std::vector<const void *> &vec, koopa_raw_slice_item_kind_t kind) {
     koopa_raw_slice_t res;
+    MemReport::Count(MemReport::RawSlice, sizeof(void *) * vec.size());
     res.buffer = new const void *[vec.size()];
     std::copy(vec.begin(), vec.end(), res.buffer);
     res.kind = kind;
@@ -32,6 +55,7 @@ koopa_raw_slice_t make_koopa_raw_slice(const std::vector<const void *> &vec, koo
 koopa_raw_slice_t make_koopa_raw_slice(const void *element, koopa_raw_slice_item_kind_t kind) {
     // single element
     koopa_raw_slice_t res;
+    MemReport::Count(MemReport::RawSlice, sizeof(void *));
     res.buffer = new const void *[1];
     res.buffer[0] = element;
     res.kind = kind;
@@ -45,6 +69,7 @@ koopa_raw_slice_t make_koopa_raw_slice(const void *element, koopa_raw_slice_item
 koopa_raw_slice_t add_element_to_koopa_raw_slice(koopa_raw_slice_t origin, const void *element) {
 
     koopa_raw_slice_t res;
+    MemReport::Count(MemReport::RawSlice, sizeof(void *) * (origin.len + 1));
     res.buffer = new const void *[origin.len + 1];
     memcpy(res.buffer, origin.buffer, sizeof(void *) * origin.len);
     res.buffer[origin.len] = element;
@@ -63,7 +88,7 @@ koopa_raw_slice_t add_element_to_koopa_raw_slice(koopa_raw_slice_t origin, const
 koopa_raw_type_kind* make_array_type(const std::vector<int> &sz, int st_pos) {
     std::vector<koopa_raw_type_kind*> ty_list;
     for(size_t i = st_pos; i < sz.size(); ++i) {
-        koopa_raw_type_kind *new_rt = new koopa_raw_type_kind();
+        koopa_raw_type_kind *new_rt = new_koopa_raw_type();
         new_rt->tag = KOOPA_RTT_ARRAY;
         new_rt->data.array.len = sz[i];
         ty_list.push_back(new_rt);
@@ -81,7 +106,7 @@ koopa_raw_type_kind* make_array_type(const std::vector<int> &sz, int st_pos) {
 koopa_raw_type_kind *simple_koopa_raw_type_kind(koopa_raw_type_tag_t tag) {
 
     assert(tag == KOOPA_RTT_INT32 || tag == KOOPA_RTT_UNIT);
-    koopa_raw_type_kind *res = new koopa_raw_type_kind();
+    koopa_raw_type_kind *res = new_koopa_raw_type();
     res->tag = tag;
     return res;
 }
@@ -91,7 +116,7 @@ koopa_raw_type_kind *simple_koopa_raw_type_kind(koopa_raw_type_tag_t tag) {
 /// Returns `koopa_raw_type_kind*` res, and res->data.pointer.base->tag = `KOOPA_RTT_INT32`.
 koopa_raw_type_kind* make_int_pointer_type() {
 
-    koopa_raw_type_kind *res = new koopa_raw_type_kind();
+    koopa_raw_type_kind *res = new_koopa_raw_type();
     res->tag = KOOPA_RTT_POINTER;
     res->data.pointer.base = simple_koopa_raw_type_kind(KOOPA_RTT_INT32);
     return res;
@@ -123,7 +148,7 @@ koopa_raw_type_kind* Init(koopa_raw_type_tag_t _tag,
                             )
 {
     assert(_tag == KOOPA_RTT_INT32 || _tag == KOOPA_RTT_UNIT || _tag == KOOPA_RTT_ARRAY || _tag == KOOPA_RTT_POINTER || _tag == KOOPA_RTT_FUNCTION);
-    koopa_raw_type_kind *ty = new koopa_raw_type_kind();
+    koopa_raw_type_kind *ty = new_koopa_raw_type();
     switch (_tag) {
         case KOOPA_RTT_INT32:
             break;
@@ -242,7 +267,7 @@ koopa_raw_value_kind_t make_koopa_raw_value_kind(koopa_raw_value_tag_t _tag,
 ///
 koopa_raw_value_data *make_koopa_interger(int x) {
 
-    koopa_raw_value_data *res = new koopa_raw_value_data();
+    koopa_raw_value_data *res = new_koopa_raw_value();
     res->ty = simple_koopa_raw_type_kind(KOOPA_RTT_INT32);
     res->name = nullptr;
     res->used_by = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
@@ -257,7 +282,7 @@ koopa_raw_value_data *make_koopa_interger(int x) {
 /// Return an intrustion about 'jump' (`koopa_raw_value_data`).
 koopa_raw_value_data *JumpInst(koopa_raw_basic_block_t target) {
 
-    koopa_raw_value_data *res = new koopa_raw_value_data();
+    koopa_raw_value_data *res = new_koopa_raw_value();
     res->ty = simple_koopa_raw_type_kind(KOOPA_RTT_UNIT);
     res->name = nullptr;
     res->used_by = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
@@ -273,7 +298,7 @@ koopa_raw_value_data *JumpInst(koopa_raw_basic_block_t target) {
 /// Return an intrustion about 'alloc(int)' (`koopa_raw_value_data`).
 koopa_raw_value_data *AllocIntInst(const std::string &name) {
 
-    koopa_raw_value_data *res = new koopa_raw_value_data();
+    koopa_raw_value_data *res = new_koopa_raw_value();
     res->ty = make_int_pointer_type();
     res->name = new_char_arr(name);
     res->used_by = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
@@ -287,8 +312,8 @@ koopa_raw_value_data *AllocIntInst(const std::string &name) {
 /// Return an intrustion about 'alloc(type)' (`koopa_raw_value_data`).
 koopa_raw_value_data *AllocType(const std::string &name, koopa_raw_type_t ty) {
 
-    koopa_raw_value_data *res = new koopa_raw_value_data();
-    koopa_raw_type_kind *tty = new koopa_raw_type_kind();
+    koopa_raw_value_data *res = new_koopa_raw_value();
+    koopa_raw_type_kind *tty = new_koopa_raw_type();
     tty->tag = KOOPA_RTT_POINTER;
     tty->data.pointer.base = ty;
     res->ty = tty;
@@ -304,7 +329,7 @@ koopa_raw_value_data *AllocType(const std::string &name, koopa_raw_type_t ty) {
 /// Return an empty structure with res->ty = _type (or 'int'), res->kind.tag = `KOOPA_RVT_ZERO_INIT`.
 koopa_raw_value_data *ZeroInit(koopa_raw_type_kind *_type) {
 
-    koopa_raw_value_data *res = new koopa_raw_value_data();
+    koopa_raw_value_data *res = new_koopa_raw_value();
     if(_type)
         res->ty = _type;
     else
@@ -314,6 +339,135 @@ koopa_raw_value_data *ZeroInit(koopa_raw_type_kind *_type) {
     res->kind.tag = KOOPA_RVT_ZERO_INIT;
     return res;
 }
+/// 
+/// Parameters are an operator and two `i32` operands.
+///
+/// Return an instruction about 'binary' (`koopa_raw_value_data`).
+koopa_raw_value_data *BinaryInst(koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs) {
+
+    return Init(simple_koopa_raw_type_kind(KOOPA_RTT_INT32),
+        nullptr,
+        empty_koopa_raw_slice(KOOPA_RSIK_VALUE),
+        make_koopa_raw_value_kind(KOOPA_RVT_BINARY, op, lhs, rhs));
+}
+
+/// 
+/// Parameters are a pointer to an array (`*[T, n]`) and an index.
+///
+/// Return an instruction about 'getelemptr' (`koopa_raw_value_data`) of type `*T`.
+koopa_raw_value_data *GetElemPtrInst(koopa_raw_value_t src, koopa_raw_value_t index) {
+
+    koopa_raw_type_kind *ty = new_koopa_raw_type();
+    ty->tag = KOOPA_RTT_POINTER;
+    ty->data.pointer.base = src->ty->data.pointer.base->data.array.base;
+    return Init(ty, nullptr, empty_koopa_raw_slice(KOOPA_RSIK_VALUE),
+        make_koopa_raw_value_kind(KOOPA_RVT_GET_ELEM_PTR, 0, src, index));
+}
+
+/// 
+/// Parameters are a pointer and an index.
+///
+/// Return an instruction about 'getptr' (`koopa_raw_value_data`) of the same type as `src`.
+koopa_raw_value_data *GetPtrInst(koopa_raw_value_t src, koopa_raw_value_t index) {
+
+    return Init(src->ty, nullptr, empty_koopa_raw_slice(KOOPA_RSIK_VALUE),
+        make_koopa_raw_value_kind(KOOPA_RVT_GET_PTR, 0, src, index));
+}
+
+/// 
+/// Parameter is a pointer.
+///
+/// Return an instruction about 'load' (`koopa_raw_value_data`).
+koopa_raw_value_data *LoadInst(koopa_raw_value_t src) {
+
+    return Init(src->ty->data.pointer.base, nullptr, empty_koopa_raw_slice(KOOPA_RSIK_VALUE),
+        make_koopa_raw_value_kind(KOOPA_RVT_LOAD, 0, src));
+}
+
+/// 
+/// Parameters are a value and the pointer it is stored to.
+///
+/// Return an instruction about 'store' (`koopa_raw_value_data`).
+koopa_raw_value_data *StoreInst(koopa_raw_value_t value, koopa_raw_value_t dest) {
+
+    return Init(simple_koopa_raw_type_kind(KOOPA_RTT_UNIT), nullptr, empty_koopa_raw_slice(KOOPA_RSIK_VALUE),
+        make_koopa_raw_value_kind(KOOPA_RVT_STORE, 0, value, dest));
+}
+
+/// 
+/// Parameters are a condition and two targets (`koopa_raw_basic_block_t`).
+///
+/// Return an instruction about 'br' (`koopa_raw_value_data`).
+koopa_raw_value_data *BranchInst(koopa_raw_value_t cond, koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) {
+
+    koopa_raw_value_data *res = Init(simple_koopa_raw_type_kind(KOOPA_RTT_UNIT), nullptr,
+        empty_koopa_raw_slice(KOOPA_RSIK_VALUE), make_koopa_raw_value_kind(KOOPA_RVT_BRANCH));
+    koopa_raw_branch_t &branch = res->kind.data.branch;
+    branch.cond = cond;
+    branch.true_bb = true_bb;
+    branch.false_bb = false_bb;
+    branch.true_args = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
+    branch.false_args = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
+    return res;
+}
+
+/// 
+/// Parameters are a function and its arguments.
+///
+/// Return an instruction about 'call' (`koopa_raw_value_data`).
+koopa_raw_value_data *CallInst(koopa_raw_function_t callee, const std::vector<const void *> &args) {
+
+    koopa_raw_value_data *res = Init(callee->ty->data.function.ret, nullptr,
+        empty_koopa_raw_slice(KOOPA_RSIK_VALUE), make_koopa_raw_value_kind(KOOPA_RVT_CALL));
+    res->kind.data.call.callee = callee;
+    res->kind.data.call.args = make_koopa_raw_slice(args, KOOPA_RSIK_VALUE);
+    return res;
+}
+
+/// 
+/// Parameter is a name, like "%while_entry".
+///
+/// Return an empty basic block without parameters; its instructions are filled in by `Block`.
+koopa_raw_basic_block_data_t *BasicBlock(const std::string &name) {
+
+    koopa_raw_basic_block_data_t *res = new_koopa_raw_basic_block();
+    res->name = new_char_arr(name);
+    res->params = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
+    res->used_by = empty_koopa_raw_slice(KOOPA_RSIK_VALUE);
+    return res;
+}
+
+/// 
+/// Constant folding of the address arithmetic built by the front end.
+///
+/// Return the value of `lhs op rhs` if it is known without emitting an instruction
+/// (both operands constant, or `x + 0`, `x * 1`, `x * 0`), nullptr otherwise.
+koopa_raw_value_t FoldBinary(koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs) {
+
+    bool lc = lhs->kind.tag == KOOPA_RVT_INTEGER, rc = rhs->kind.tag == KOOPA_RVT_INTEGER;
+    int32_t l = lc ? lhs->kind.data.integer.value : 0, r = rc ? rhs->kind.data.integer.value : 0;
+    switch (op) {
+        case KOOPA_RBO_ADD:
+            if (lc && rc)
+                return make_koopa_interger((int32_t)((uint32_t)l + (uint32_t)r));
+            if (lc && l == 0)
+                return rhs;
+            if (rc && r == 0)
+                return lhs;
+            break;
+        case KOOPA_RBO_MUL:
+            if (lc && rc)
+                return make_koopa_interger((int32_t)((uint32_t)l * (uint32_t)r));
+            if ((lc && l == 0) || (rc && r == 1))
+                return lhs;
+            if ((rc && r == 0) || (lc && l == 1))
+                return rhs;
+            break;
+        default:
+            break;
+    }
+    return nullptr;
+}
 // Initialize koopa ra value data.
 //struct koopa_raw_value_data {
   /// Type of value.
@@ -330,7 +484,7 @@ koopa_raw_value_data *Init(koopa_raw_type_t _ty,
                             koopa_raw_slice_t _used_by,
                             koopa_raw_value_kind_t _kind)
 {
-    koopa_raw_value_data *res = new koopa_raw_value_data();
+    koopa_raw_value_data *res = new_koopa_raw_value();
     res->ty = _ty;
     res->name = _name;
     res->used_by = _used_by;
@@ -5,6 +5,12 @@
 #include <vector>
 #include <koopa.h>
 
+// Allocation of raw nodes. They are charged to their kind in `-mem-report`.
+koopa_raw_value_data *new_koopa_raw_value();
+koopa_raw_type_kind *new_koopa_raw_type();
+koopa_raw_basic_block_data_t *new_koopa_raw_basic_block();
+koopa_raw_function_data_t *new_koopa_raw_function();
+
 koopa_raw_slice_t empty_koopa_raw_slice(koopa_raw_slice_item_kind_t kind = KOOPA_RSIK_UNKNOWN);
 koopa_raw_slice_t make_koopa_raw_slice(const std::vector<const void*> &vec, koopa_raw_slice_item_kind_t kind = KOOPA_RSIK_UNKNOWN); // vector
 koopa_raw_slice_t make_koopa_raw_slice(const void *element, koopa_raw_slice_item_kind_t kind = KOOPA_RSIK_UNKNOWN); // single element
@@ -32,6 +38,15 @@ koopa_raw_value_data *JumpInst(koopa_raw_basic_block_t target);
 koopa_raw_value_data *AllocIntInst(const std::string &name);
 koopa_raw_value_data *AllocType(const std::string &name, koopa_raw_type_t ty);
 koopa_raw_value_data *ZeroInit(koopa_raw_type_kind *_type = nullptr);
+koopa_raw_value_data *BinaryInst(koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs);
+koopa_raw_value_data *GetElemPtrInst(koopa_raw_value_t src, koopa_raw_value_t index);
+koopa_raw_value_data *GetPtrInst(koopa_raw_value_t src, koopa_raw_value_t index);
+koopa_raw_value_data *LoadInst(koopa_raw_value_t src);
+koopa_raw_value_data *StoreInst(koopa_raw_value_t value, koopa_raw_value_t dest);
+koopa_raw_value_data *BranchInst(koopa_raw_value_t cond, koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb);
+koopa_raw_value_data *CallInst(koopa_raw_function_t callee, const std::vector<const void *> &args);
+koopa_raw_basic_block_data_t *BasicBlock(const std::string &name);
+koopa_raw_value_t FoldBinary(koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs);
 koopa_raw_value_data *Init(//koopa_raw_value_data* res,
                             koopa_raw_type_t _ty,
                             const char *_name,
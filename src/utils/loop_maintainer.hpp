@@ -8,9 +8,9 @@
 #include "utils/koopa_util.hpp"
 
 struct KoopaWhile {
-    koopa_raw_basic_block_data_t *while_entry;
+    koopa_raw_basic_block_data_t *while_entry;  // 循环底部的条件判断, continue 的目标
     koopa_raw_basic_block_data_t *while_body;
-    koopa_raw_basic_block_data_t *end_block;
+    koopa_raw_basic_block_data_t *end_block;    // break 的目标
 };
 
 class LoopMaintainer {
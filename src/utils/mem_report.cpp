@@ -0,0 +1,177 @@
+#include "utils/mem_report.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+#include <new>
+#include <sys/resource.h>
+
+bool MemReport::enabled = false;
+std::vector<MemReport::Phase> MemReport::phases;
+std::vector<int> MemReport::open_stk;
+size_t MemReport::kind_allocs[MemReport::KindNum];
+size_t MemReport::kind_bytes[MemReport::KindNum];
+size_t MemReport::live = 0;
+size_t MemReport::peak_live = 0;
+size_t MemReport::total_allocs = 0;
+size_t MemReport::total_bytes = 0;
+
+static void print_mem_report() {
+    MemReport::Print(std::cerr);
+}
+
+void MemReport::Enable() {
+    if (enabled)
+        return;
+    enabled = true;
+    std::atexit(print_mem_report);
+}
+
+int MemReport::EnterPhase(const char *name) {
+    int parent = open_stk.empty() ? -1 : open_stk.back();
+    int idx = -1;
+    for (size_t i = 0; i < phases.size(); ++i)
+        if (phases[i].parent == parent && phases[i].name == name) {
+            idx = i;
+            break;
+        }
+    if (idx < 0) {
+        Phase p;
+        p.name = name;
+        p.parent = parent;
+        p.depth = parent < 0 ? 0 : phases[parent].depth + 1;
+        p.allocs = p.bytes = p.peak_live = 0;
+        phases.push_back(p);
+        idx = phases.size() - 1;
+    }
+    if (phases[idx].peak_live < live)
+        phases[idx].peak_live = live;
+    open_stk.push_back(idx);
+    return idx;
+}
+
+void MemReport::LeavePhase(int idx) {
+    open_stk.pop_back();
+    // A sub-phase's peak is also reached inside its parents.
+    if (!open_stk.empty() && phases[open_stk.back()].peak_live < phases[idx].peak_live)
+        phases[open_stk.back()].peak_live = phases[idx].peak_live;
+}
+
+//
+// Must not allocate: it runs inside `operator new`.
+//
+void MemReport::OnAlloc(size_t bytes) {
+    total_allocs++;
+    total_bytes += bytes;
+    live += bytes;
+    if (live > peak_live)
+        peak_live = live;
+    if (!open_stk.empty()) {
+        Phase &p = phases[open_stk.back()];
+        p.allocs++;
+        p.bytes += bytes;
+        if (live > p.peak_live)
+            p.peak_live = live;
+    }
+}
+
+void MemReport::OnFree(size_t bytes) {
+    live -= bytes < live ? bytes : live;
+}
+
+//
+// Peak resident set size in KiB. VmHWM belongs to the current address space only, while
+// ru_maxrss also keeps the RSS of the process before `exec` (e.g. a forking benchmark driver).
+//
+static double peak_rss_kib() {
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f) {
+        char line[256];
+        long kib = -1;
+        while (fgets(line, sizeof(line), f))
+            if (strncmp(line, "VmHWM:", 6) == 0) {
+                kib = strtol(line + 6, nullptr, 10);
+                break;
+            }
+        fclose(f);
+        if (kib >= 0)
+            return kib;
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void MemReport::Print(std::ostream &os) {
+    static const char *kind_name[KindNum] = {
+        "AST nodes", "raw values", "raw types", "raw slices", "raw basic blocks", "raw functions", "strings"
+    };
+    char line[256];
+
+    os << "===---------------------------------------------------------===" << std::endl;
+    os << "                   Compiler memory report" << std::endl;
+    os << "===---------------------------------------------------------===" << std::endl;
+    snprintf(line, sizeof(line), "  Peak RSS: %.1f KiB, peak live heap: %.1f KiB", peak_rss_kib(), peak_live / 1024.0);
+    os << line << std::endl;
+    snprintf(line, sizeof(line), "  Total: %zu allocations, %.1f KiB", total_allocs, total_bytes / 1024.0);
+    os << line << std::endl << std::endl;
+
+    // Exclusive counts: an allocation is charged to the innermost running phase only.
+    os << "      Allocs    Alloc (KiB)   Peak live (KiB)  Phase" << std::endl;
+    std::vector<int> stk;
+    for (int i = phases.size() - 1; i >= 0; --i)
+        if (phases[i].parent < 0)
+            stk.push_back(i);
+    while (!stk.empty()) {
+        int cur = stk.back();
+        const Phase &p = phases[cur];
+        stk.pop_back();
+        snprintf(line, sizeof(line), "%12zu  %13.1f  %16.1f  %*s%s",
+            p.allocs, p.bytes / 1024.0, p.peak_live / 1024.0, p.depth * 2, "", p.name.c_str());
+        os << line << std::endl;
+        for (int i = phases.size() - 1; i > cur; --i)
+            if (phases[i].parent == cur)
+                stk.push_back(i);
+    }
+    os << std::endl;
+
+    os << "      Allocs    Alloc (KiB)  Node kind" << std::endl;
+    for (int k = 0; k < KindNum; ++k) {
+        snprintf(line, sizeof(line), "%12zu  %13.1f  %s", kind_allocs[k], kind_bytes[k] / 1024.0, kind_name[k]);
+        os << line << std::endl;
+    }
+}
+
+//
+// Replacements of the global allocation functions. They only add a branch when the report is off.
+//
+static void *counted_alloc(size_t size) {
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    if (MemReport::enabled)
+        MemReport::OnAlloc(malloc_usable_size(p));
+    return p;
+}
+
+static void counted_free(void *p) {
+    if (!p)
+        return;
+    if (MemReport::enabled)
+        MemReport::OnFree(malloc_usable_size(p));
+    free(p);
+}
+
+void *operator new(size_t size) { return counted_alloc(size); }
+void *operator new[](size_t size) { return counted_alloc(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    try { return counted_alloc(size); } catch (...) { return nullptr; }
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    try { return counted_alloc(size); } catch (...) { return nullptr; }
+}
+void operator delete(void *p) noexcept { counted_free(p); }
+void operator delete[](void *p) noexcept { counted_free(p); }
+void operator delete(void *p, size_t) noexcept { counted_free(p); }
+void operator delete[](void *p, size_t) noexcept { counted_free(p); }
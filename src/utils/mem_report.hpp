@@ -0,0 +1,60 @@
+#ifndef MEM_REPORT_H
+#define MEM_REPORT_H
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Allocation accounting of the compiler, enabled by `-mem-report`.
+//
+// Every heap allocation goes through the replaced global `operator new` and is charged to
+// the innermost running phase (see `PhaseScope`). Allocations of IR and AST nodes are also
+// charged to their node kind by the helpers which create them.
+class MemReport {
+public:
+    enum Kind {
+        AstNode,
+        RawValue,
+        RawType,
+        RawSlice,
+        RawBasicBlock,
+        RawFunction,
+        String,
+        KindNum
+    };
+
+private:
+    struct Phase {
+        std::string name;
+        int parent;
+        int depth;
+        size_t allocs;
+        size_t bytes;
+        size_t peak_live;   // highest live heap size seen while the phase was running
+    };
+    static std::vector<Phase> phases;
+    static std::vector<int> open_stk;
+    static size_t kind_allocs[KindNum];
+    static size_t kind_bytes[KindNum];
+    static size_t live, peak_live, total_allocs, total_bytes;
+
+public:
+    static bool enabled;
+
+    // Turn the report on. The tables are printed to stderr when the program exits.
+    static void Enable();
+    static int EnterPhase(const char *name);
+    static void LeavePhase(int idx);
+    // Hooks of the global allocator, `bytes` is the usable size of the block.
+    static void OnAlloc(size_t bytes);
+    static void OnFree(size_t bytes);
+    static void Count(Kind kind, size_t bytes) {
+        if (enabled) {
+            kind_allocs[kind]++;
+            kind_bytes[kind] += bytes;
+        }
+    }
+    static void Print(std::ostream &os);
+};
+#endif
@@ -0,0 +1,47 @@
+#include "utils/profile.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+bool ProfileData::Load(const std::string &path) {
+    std::ifstream in(path);
+    if (!in)
+        return false;
+    bool found = false;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line == "#profile") {
+            found = true;
+            continue;
+        }
+        if (!found || line.empty())
+            continue;
+        std::istringstream ls(line);
+        std::string name;
+        size_t n;
+        char colon;
+        if (!(ls >> name >> n >> colon) || colon != ':') {
+            std::cerr << path << ": malformed profile line: " << line << std::endl;
+            continue;
+        }
+        std::vector<uint64_t> &blocks = counts[name];
+        if (blocks.size() != n) {
+            if (!blocks.empty())
+                std::cerr << path << ": block count of " << name << " differs between runs" << std::endl;
+            blocks.assign(n, 0);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            // the counters are 32-bit words printed by putarray as signed ints
+            int64_t c = 0;
+            ls >> c;
+            blocks[i] += (uint32_t)c;
+        }
+    }
+    return found;
+}
+
+const std::vector<uint64_t> *ProfileData::Find(const std::string &name) const {
+    auto it = counts.find(name);
+    return it == counts.end() ? nullptr : &it->second;
+}
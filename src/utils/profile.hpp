@@ -0,0 +1,26 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Basic block execution counts read by `-fprofile-use=<file>`.
+//
+// The file is the output of a program compiled with `-instrument`: everything before the
+// first `#profile` line is the program's own output and is skipped, then every line is
+//
+//     <function> <n>: <count of block 0> ... <count of block n-1>
+//
+// Several runs may be concatenated into one file, their counts are summed.
+class ProfileData {
+    std::map<std::string, std::vector<uint64_t>> counts;
+
+public:
+    // Read `path`, returns false if it can't be opened or has no `#profile` section.
+    bool Load(const std::string &path);
+    // Block counts of function `name` (without '@'), in the order of its `bbs`, or nullptr.
+    const std::vector<uint64_t> *Find(const std::string &name) const;
+};
+#endif
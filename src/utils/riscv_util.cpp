@@ -1,4 +1,9 @@
+#include <cstdint>
+#include <cstring>
+
 #include "utils/riscv_util.hpp"
+#include "utils/const_init.hpp"
+#include "utils/time_report.hpp"
 
 //
 // Load certain koopa raw value `kval` to register `reg`
@@ -7,7 +12,31 @@
 //
 // Or we must calculate the target pointer address first.
 void koopa2RISCV::Load(koopa_raw_value_t kval, const string &reg) {
-    if (kval->kind.tag == KOOPA_RVT_INTEGER)
+    auto static_it = static_addr.find(kval);
+    if (static_it != static_addr.end()) {
+        // 编译期已知的指针: 直接算出地址
+        const StaticAddr &sa = static_it->second;
+        if (sa.sym) {
+            output << "    la " << reg << ", " << sa.sym << endl;
+            if (sa.offset != 0) {
+                if (sa.offset < -2048 || sa.offset > 2047) {
+                    output << "    li t2, " << sa.offset << endl;
+                    output << "    add " << reg << ", " << reg << ", t2" << endl;
+                }
+                else
+                    output << "    addi " << reg << ", " << reg << ", " << sa.offset << endl;
+            }
+        }
+        else if (sa.offset < -2048 || sa.offset > 2047) {
+            output << "    li " << reg << ", " << sa.offset << endl;
+            output << "    add " << reg << ", sp, " << reg << endl;
+        }
+        else
+            output << "    addi " << reg << ", sp, " << sa.offset << endl;
+    }
+    else if (koopa_raw_value_t src = zero_offset_src(kval))
+        Load(src, reg);
+    else if (kval->kind.tag == KOOPA_RVT_INTEGER)
         output << "    li " << reg << ", " << kval->kind.data.integer.value << endl;
     else if(kval->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
         output << "    la t0, " << kval->name + 1 << endl;
@@ -44,44 +73,480 @@ void koopa2RISCV::Store(int addr, const string &reg) {
         output << "    sw " << reg << ", " << addr << "(sp)" << endl;
 }
 //
-// Generate RISC-V value globally and totally.
+// Memory operand `offset(base)` addressing the word `ptr` points to, for `lw`/`sw`.
+//
+// A static address becomes `offset(sp)`, or `offset(reg)` after `la reg, sym`.
+// Any other pointer is loaded to `reg` from its stack slot.
+string koopa2RISCV::mem_operand(koopa_raw_value_t ptr, const string &reg) {
+    auto static_it = static_addr.find(ptr);
+    if (static_it == static_addr.end() || static_it->second.offset < -2048 || static_it->second.offset > 2047) {
+        Load(ptr, reg);
+        return "0(" + reg + ")";
+    }
+    const StaticAddr &sa = static_it->second;
+    if (!sa.sym)
+        return std::to_string(sa.offset) + "(sp)";
+    output << "    la " << reg << ", " << sa.sym << endl;
+    return std::to_string(sa.offset) + "(" + reg + ")";
+}
+//
+// `src` of a getelemptr/getptr with index 0, which is the same address as `src` (e.g. the
+// decay of an array parameter), nullptr for any other value.
+//
+koopa_raw_value_t koopa2RISCV::zero_offset_src(koopa_raw_value_t kval) {
+    if (kval->kind.tag == KOOPA_RVT_GET_ELEM_PTR) {
+        const koopa_raw_get_elem_ptr_t &get = kval->kind.data.get_elem_ptr;
+        if (get.index->kind.tag == KOOPA_RVT_INTEGER && get.index->kind.data.integer.value == 0)
+            return get.src;
+    }
+    else if (kval->kind.tag == KOOPA_RVT_GET_PTR) {
+        const koopa_raw_get_ptr_t &get = kval->kind.data.get_ptr;
+        if (get.index->kind.tag == KOOPA_RVT_INTEGER && get.index->kind.data.integer.value == 0)
+            return get.src;
+    }
+    return nullptr;
+}
+//
+// Find the getelemptr/getptr of `kfunc` whose result is known at compile time: a constant
+// index into a global, a local array or another such pointer. Repeated until nothing
+// changes, so the result does not depend on the order the blocks are visited in.
+//
+void koopa2RISCV::calc_static_addr(koopa_raw_function_t kfunc) {
+    static_addr.clear();
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (uint32_t i = 0; i < kfunc->bbs.len; ++i) {
+            koopa_raw_basic_block_t kblk = (koopa_raw_basic_block_t)kfunc->bbs.buffer[i];
+            for (uint32_t j = 0; j < kblk->insts.len; ++j) {
+                koopa_raw_value_t kval = (koopa_raw_value_t)kblk->insts.buffer[j];
+                koopa_raw_value_t src, index;
+                size_t stride;
+                if (kval->kind.tag == KOOPA_RVT_GET_ELEM_PTR) {
+                    src = kval->kind.data.get_elem_ptr.src;
+                    index = kval->kind.data.get_elem_ptr.index;
+                    stride = calc_type_size(src->ty->data.pointer.base->data.array.base);
+                }
+                else if (kval->kind.tag == KOOPA_RVT_GET_PTR) {
+                    src = kval->kind.data.get_ptr.src;
+                    index = kval->kind.data.get_ptr.index;
+                    stride = calc_type_size(src->ty->data.pointer.base);
+                }
+                else
+                    continue;
+                if (index->kind.tag != KOOPA_RVT_INTEGER || static_addr.count(kval))
+                    continue;
+                StaticAddr base;
+                if (src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
+                    base = StaticAddr{src->name + 1, 0};
+                else if (src->kind.tag == KOOPA_RVT_ALLOC)
+                    base = StaticAddr{nullptr, env.addr(src)};
+                else if (static_addr.count(src))
+                    base = static_addr[src];
+                else
+                    continue;
+                base.offset += index->kind.data.integer.value * (int)stride;
+                static_addr.emplace(kval, base);
+                changed = true;
+            }
+        }
+    }
+}
+//
+// Find the comparisons of `kfunc` which can be fused into the branch ending their block.
+//
+// The uses are counted here rather than taken from `used_by`, which is not filled in for
+// every program. A comparison used anywhere else still has to be computed and stored.
+//
+static void count_uses(koopa_raw_value_t kval, map<koopa_raw_value_t, int> &uses) {
+    auto use = [&uses](koopa_raw_value_t v) {
+        if (v)
+            ++uses[v];
+    };
+    const koopa_raw_value_kind_t &kind = kval->kind;
+    switch (kind.tag) {
+    case KOOPA_RVT_LOAD:
+        use(kind.data.load.src);
+        break;
+    case KOOPA_RVT_STORE:
+        use(kind.data.store.value);
+        use(kind.data.store.dest);
+        break;
+    case KOOPA_RVT_GET_PTR:
+        use(kind.data.get_ptr.src);
+        use(kind.data.get_ptr.index);
+        break;
+    case KOOPA_RVT_GET_ELEM_PTR:
+        use(kind.data.get_elem_ptr.src);
+        use(kind.data.get_elem_ptr.index);
+        break;
+    case KOOPA_RVT_BINARY:
+        use(kind.data.binary.lhs);
+        use(kind.data.binary.rhs);
+        break;
+    case KOOPA_RVT_BRANCH:
+        use(kind.data.branch.cond);
+        break;
+    case KOOPA_RVT_CALL:
+        for (uint32_t i = 0; i < kind.data.call.args.len; ++i)
+            use((koopa_raw_value_t)kind.data.call.args.buffer[i]);
+        break;
+    case KOOPA_RVT_RETURN:
+        use(kind.data.ret.value);
+        break;
+    default:
+        break;
+    }
+}
+
+static bool is_compare(koopa_raw_binary_op_t op) {
+    return op == KOOPA_RBO_EQ || op == KOOPA_RBO_NOT_EQ || op == KOOPA_RBO_LT ||
+           op == KOOPA_RBO_GT || op == KOOPA_RBO_LE || op == KOOPA_RBO_GE;
+}
+
+void koopa2RISCV::calc_fused_cmp(koopa_raw_function_t kfunc) {
+    fused_cmp.clear();
+    map<koopa_raw_value_t, int> uses;
+    for (uint32_t i = 0; i < kfunc->bbs.len; ++i) {
+        koopa_raw_basic_block_t kblk = (koopa_raw_basic_block_t)kfunc->bbs.buffer[i];
+        for (uint32_t j = 0; j < kblk->insts.len; ++j)
+            count_uses((koopa_raw_value_t)kblk->insts.buffer[j], uses);
+    }
+    for (uint32_t i = 0; i < kfunc->bbs.len; ++i) {
+        koopa_raw_basic_block_t kblk = (koopa_raw_basic_block_t)kfunc->bbs.buffer[i];
+        if (kblk->insts.len < 2)
+            continue;
+        koopa_raw_value_t term = (koopa_raw_value_t)kblk->insts.buffer[kblk->insts.len - 1];
+        if (term->kind.tag != KOOPA_RVT_BRANCH)
+            continue;
+        koopa_raw_value_t cond = term->kind.data.branch.cond;
+        if (cond->kind.tag != KOOPA_RVT_BINARY || !is_compare(cond->kind.data.binary.op) || uses[cond] != 1)
+            continue;
+        // 比较必须在同一个块中
+        for (uint32_t j = 0; j + 1 < kblk->insts.len; ++j)
+            if (kblk->insts.buffer[j] == cond)
+                fused_cmp.insert(cond);
+    }
+}
+//
+// Find the loops of `kfunc` to run with RVV, see `emit_vector_loop`.
+//
+void koopa2RISCV::calc_vector_loops(koopa_raw_function_t kfunc) {
+    vector_loops.clear();
+    if (!opts.rvv)
+        return;
+    for (const CountedLoop &loop : FindCountedLoops(kfunc)) {
+        VectorLoop vl;
+        if (!MatchVectorLoop(kfunc, loop, vl))
+            continue;
+        koopa_raw_basic_block_t pre = (koopa_raw_basic_block_t)kfunc->bbs.buffer[loop.pre];
+        koopa_raw_value_t term = (koopa_raw_value_t)pre->insts.buffer[pre->insts.len - 1];
+        // 守卫是常量时 pre 直接跳进循环
+        if ((term->kind.tag == KOOPA_RVT_BRANCH && term->kind.data.branch.true_bb == vl.body &&
+             term->kind.data.branch.false_bb == loop.exit) ||
+            (term->kind.tag == KOOPA_RVT_JUMP && term->kind.data.jump.target == vl.body))
+            vector_loops.emplace(term, vl);
+    }
+}
+
+static const char *vector_op_name(koopa_raw_binary_op_t op) {
+    switch (op) {
+    case KOOPA_RBO_ADD: return "vadd";
+    case KOOPA_RBO_SUB: return "vsub";
+    case KOOPA_RBO_MUL: return "vmul";
+    case KOOPA_RBO_DIV: return "vdiv";
+    case KOOPA_RBO_MOD: return "vrem";
+    case KOOPA_RBO_AND: return "vand";
+    case KOOPA_RBO_OR:  return "vor";
+    case KOOPA_RBO_XOR: return "vxor";
+    case KOOPA_RBO_SHL: return "vsll";
+    case KOOPA_RBO_SHR: return "vsrl";
+    case KOOPA_RBO_SAR: return "vsra";
+    default: return nullptr;
+    }
+}
+//
+// The loop `vl` with RVV, emitted at the end of its `pre`, before the branch (or jump) into
+// the loop.
+//
+// With k = n - i iterations left (k + 1 for `<=`), in strips of vl <= VLMAX lanes:
+//
+//     prologue:  the SCALAR and ADDRESS values of the body for the first i, the overlap
+//                checks, the ADDRESS pointers to a0-a5/t3-t5, a6 = 0 iterations done
+//     strip:     vsetvli t6, a7, e32, m1; the body with one lane per iteration;
+//                pointers += 4 * vl; a6 += vl; a7 -= vl; bnez a7, strip
+//     epilogue:  i = n (n + 1 for `<=`), the reduction summed into its variable; j exit
 //
-// Add the `.word` part at the beginning of the code.
+// The sum is kept in v31 (tail undisturbed so a short last strip keeps the other lanes),
+// v30 holds a scalar splat and v0 a comparison mask. Nothing is done when the loop runs
+// no iteration or an overlap check fails, the branch after it enters the scalar loop then.
 //
-void koopa2RISCV::Visit_aggregate(koopa_raw_value_t kval) {
-    if(kval->ty->tag == KOOPA_RTT_ARRAY) {
+void koopa2RISCV::emit_vector_loop(const VectorLoop &vl) {
+    const CountedLoop &loop = vl.loop;
+    string skip = string(current_func_name) + "_vskip_" + std::to_string(jump_index);
+    string strip = string(current_func_name) + "_vloop_" + std::to_string(jump_index++);
+    auto kind = [&vl](koopa_raw_value_t kval) {
+        auto it = vl.kind.find(kval);
+        return it == vl.kind.end() ? VectorLoop::SCALAR : it->second;
+    };
+    auto linear = [&vl](koopa_raw_value_t kval) {
+        auto it = vl.coef.find(kval);
+        return it != vl.coef.end() && it->second != 0;
+    };
+    const koopa_raw_slice_t &insts = vl.body->insts;
+
+    // a7 = 剩下的次数, 先比较再相减, 不会因为溢出把不执行的循环当成执行
+    output << endl;
+    Load(loop.bound_var ? loop.bound_var : loop.bound, "a7");
+    Load(loop.iv, "t1");
+    output << "    " << (loop.op == KOOPA_RBO_LE ? "bgt" : "bge") << " t1, a7, " << skip << endl;
+    output << "    sub a7, a7, t1" << endl;
+    if (loop.op == KOOPA_RBO_LE) {
+        output << "    addi a7, a7, 1" << endl;
+        output << "    beqz a7, " << skip << endl;
+    }
+    for (uint32_t j = 0; j < insts.len; ++j) {
+        koopa_raw_value_t kval = (koopa_raw_value_t)insts.buffer[j];
+        if (kind(kval) == VectorLoop::SCALAR || kind(kval) == VectorLoop::ADDRESS)
+            gen_riscv_value(kval);
+    }
+    output << endl;
+    if (!vl.overlap.empty()) {
+        output << "    csrr t5, vlenb" << endl;
+        output << "    addi t5, t5, -1" << endl;
+        for (const auto &pair : vl.overlap) {
+            Load(pair.first, "t3");
+            Load(pair.second, "t4");
+            output << "    sub t3, t3, t4" << endl;
+            output << "    addi t3, t3, -1" << endl;
+            output << "    bltu t3, t5, " << skip << endl;
+        }
+    }
+    static const char *const ptr_regs[] = {"a0", "a1", "a2", "a3", "a4", "a5", "t3", "t4", "t5"};
+    map<koopa_raw_value_t, string> ptr;
+    bool iota = false;
+    for (uint32_t j = 0; j < insts.len; ++j) {
+        koopa_raw_value_t kval = (koopa_raw_value_t)insts.buffer[j];
+        const koopa_raw_value_kind_t &k = kval->kind;
+        if (kind(kval) == VectorLoop::ADDRESS) {
+            string reg = ptr_regs[ptr.size()];
+            ptr[kval] = reg;
+            Load(kval, reg);
+        }
+        else if (kind(kval) == VectorLoop::VECTOR && k.tag == KOOPA_RVT_BINARY)
+            iota |= linear(k.data.binary.lhs) || linear(k.data.binary.rhs);
+        else if (kind(kval) == VectorLoop::STORE)
+            iota |= linear(k.data.store.value);
+    }
+    iota |= vl.sum && linear(vl.summand);
+    if (iota)
+        output << "    li a6, 0" << endl;
+    if (vl.sum) {
+        output << "    vsetvli t1, x0, e32, m1, ta, ma" << endl;
+        output << "    vmv.v.i v31, 0" << endl;
+    }
+
+    output << strip << ":" << endl;
+    output << "    vsetvli t6, a7, e32, m1, " << (vl.sum ? "tu, mu" : "ta, ma") << endl;
+    map<koopa_raw_value_t, string> vreg;
+    int next = 1;
+    // VECTOR 值的寄存器; 线性的 SCALAR 展开成 r + coef * (a6 + 车道号); 其余的返回空串
+    auto lanes = [&](koopa_raw_value_t kval) -> string {
+        auto it = vreg.find(kval);
+        if (it != vreg.end())
+            return it->second;
+        if (!linear(kval))
+            return "";
+        string v = "v" + std::to_string(next++);
+        output << "    vid.v " << v << endl;
+        output << "    vadd.vx " << v << ", " << v << ", a6" << endl;
+        int64_t c = vl.coef.at(kval);
+        if (c != 1) {
+            output << "    li t2, " << c << endl;
+            output << "    vmul.vx " << v << ", " << v << ", t2" << endl;
+        }
+        Load(kval, "t1");
+        output << "    vadd.vx " << v << ", " << v << ", t1" << endl;
+        return v;
+    };
+    // 不是向量的值广播到 v30
+    auto splat = [&](koopa_raw_value_t kval) -> string {
+        string v = lanes(kval);
+        if (!v.empty())
+            return v;
+        string x = operand_reg(kval, "t1");
+        output << "    vmv.v.x v30, " << x << endl;
+        return "v30";
+    };
+    for (uint32_t j = 0; j < insts.len; ++j) {
+        koopa_raw_value_t kval = (koopa_raw_value_t)insts.buffer[j];
+        const koopa_raw_value_kind_t &k = kval->kind;
+        switch (kind(kval)) {
+        case VectorLoop::VECTOR: {
+            string d = vreg[kval] = "v" + std::to_string(next++);
+            if (k.tag == KOOPA_RVT_LOAD) {
+                output << "    vle32.v " << d << ", (" << ptr.at(k.data.load.src) << ")" << endl;
+                break;
+            }
+            const koopa_raw_binary_t &bin = k.data.binary;
+            const char *op = vector_op_name(bin.op);
+            if (!op) {
+                // 比较: 结果是掩码, 再变成 0/1
+                string lhs = splat(bin.lhs), rhs = splat(bin.rhs);
+                const char *cmp = "";
+                switch (bin.op) {
+                case KOOPA_RBO_EQ:     cmp = "vmseq"; break;
+                case KOOPA_RBO_NOT_EQ: cmp = "vmsne"; break;
+                case KOOPA_RBO_LT:     cmp = "vmslt"; break;
+                case KOOPA_RBO_LE:     cmp = "vmsle"; break;
+                case KOOPA_RBO_GT:     cmp = "vmslt"; std::swap(lhs, rhs); break;
+                case KOOPA_RBO_GE:     cmp = "vmsle"; std::swap(lhs, rhs); break;
+                default: break;
+                }
+                output << "    " << cmp << ".vv v0, " << lhs << ", " << rhs << endl;
+                output << "    vmv.v.i " << d << ", 0" << endl;
+                output << "    vmerge.vim " << d << ", " << d << ", 1, v0" << endl;
+                break;
+            }
+            string lhs = lanes(bin.lhs), rhs = lanes(bin.rhs);
+            if (!lhs.empty() && !rhs.empty())
+                output << "    " << op << ".vv " << d << ", " << lhs << ", " << rhs << endl;
+            else if (!lhs.empty()) {
+                string x = operand_reg(bin.rhs, "t1");
+                output << "    " << op << ".vx " << d << ", " << lhs << ", " << x << endl;
+            }
+            else {
+                string x = operand_reg(bin.lhs, "t1");
+                if (bin.op == KOOPA_RBO_ADD || bin.op == KOOPA_RBO_MUL || bin.op == KOOPA_RBO_AND ||
+                    bin.op == KOOPA_RBO_OR || bin.op == KOOPA_RBO_XOR)
+                    output << "    " << op << ".vx " << d << ", " << rhs << ", " << x << endl;
+                else if (bin.op == KOOPA_RBO_SUB)
+                    output << "    vrsub.vx " << d << ", " << rhs << ", " << x << endl;
+                else {
+                    output << "    vmv.v.x v30, " << x << endl;
+                    output << "    " << op << ".vv " << d << ", v30, " << rhs << endl;
+                }
+            }
+            break;
+        }
+        case VectorLoop::STORE: {
+            string v = splat(k.data.store.value);
+            output << "    vse32.v " << v << ", (" << ptr.at(k.data.store.dest) << ")" << endl;
+            break;
+        }
+        case VectorLoop::REDUCE: {
+            string v = splat(vl.summand);
+            output << "    vadd.vv v31, v31, " << v << endl;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    output << "    slli t1, t6, 2" << endl;
+    for (const auto &p : ptr)
+        output << "    add " << p.second << ", " << p.second << ", t1" << endl;
+    if (iota)
+        output << "    add a6, a6, t6" << endl;
+    output << "    sub a7, a7, t6" << endl;
+    output << "    bnez a7, " << strip << endl;
+
+    // i 停在 n (或 n + 1), 和标量循环结束时一样
+    Load(loop.bound_var ? loop.bound_var : loop.bound, "t1");
+    if (loop.op == KOOPA_RBO_LE)
+        output << "    addi t1, t1, 1" << endl;
+    Store(env.addr(loop.iv), "t1");
+    if (vl.sum) {
+        Load(vl.sum, "t1");
+        output << "    vsetvli t2, x0, e32, m1, ta, ma" << endl;
+        output << "    vmv.s.x v30, t1" << endl;
+        output << "    vredsum.vs v30, v31, v30" << endl;
+        output << "    vmv.x.s t1, v30" << endl;
+        if (vl.sum->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
+            output << "    la t0, " << vl.sum->name + 1 << endl;
+            output << "    sw t1, 0(t0)" << endl;
+        }
+        else
+            Store(env.addr(vl.sum), "t1");
+    }
+    output << "    j " << current_func_name << "_" << loop.exit->name + 1 << endl;
+    output << skip << ":" << endl;
+}
+//
+// Flatten an aggregate (or integer, zeroinit) initializer into `words`.
+//
+void koopa2RISCV::Visit_aggregate(koopa_raw_value_t kval, vector<int32_t> &words) {
+    if (kval->kind.tag == KOOPA_RVT_AGGREGATE) {
         for(int i = 0; i < kval->kind.data.aggregate.elems.len; ++i)
-            Visit_aggregate((koopa_raw_value_t)kval->kind.data.aggregate.elems.buffer[i]);
+            Visit_aggregate((koopa_raw_value_t)kval->kind.data.aggregate.elems.buffer[i], words);
     }
+    else if (kval->kind.tag == KOOPA_RVT_INTEGER)
+        words.push_back(kval->kind.data.integer.value);
     else
-        output << "    .word " << kval->kind.data.integer.value << endl;
+        words.resize(words.size() + calc_type_size(kval->ty) / 4, 0);
+}
+//
+// Emit `n` words of initialized data: every run of zeros becomes one `.zero`, nonzero
+// words are packed 8 per `.word` line.
+//
+void koopa2RISCV::emit_words(const int32_t *words, size_t n) {
+    for (size_t i = 0; i < n; ) {
+        size_t begin = i;
+        if (words[i] == 0) {
+            while (i < n && words[i] == 0)
+                i++;
+            output << "    .zero " << (i - begin) * 4 << endl;
+            continue;
+        }
+        output << "    .word ";
+        for (; i < n && i - begin < 8 && words[i] != 0; ++i)
+            output << (i == begin ? "" : ", ") << words[i];
+        output << endl;
+    }
+}
+//
+// True if global `kalloc` is all zero, so it can go to `.bss`.
+//
+bool koopa2RISCV::is_zero_global(koopa_raw_value_t kalloc) {
+    if (const ConstInit *init = ConstInit::Find(kalloc->name))
+        return init->runs.empty();
+    koopa_raw_value_t kinit = kalloc->kind.data.global_alloc.init;
+    if (kinit->kind.tag == KOOPA_RVT_ZERO_INIT || kinit->kind.tag == KOOPA_RVT_UNDEF)
+        return true;
+    if (kinit->kind.tag == KOOPA_RVT_INTEGER)
+        return kinit->kind.data.integer.value == 0;
+    vector<int32_t> words;
+    Visit_aggregate(kinit, words);
+    for (int32_t w : words)
+        if (w != 0)
+            return false;
+    return true;
 }
 //
 // Generate RISC-V value allocation.
 //
-//  Include '.global', '.zero', and '.word'
+//  Include '.global', '.zero', and '.word'. All-zero globals are emitted by `build` in `.bss`.
 //
 void koopa2RISCV::Visit_global_alloc(koopa_raw_value_t kalloc) {
     // Remind: delete '@' in the beginning.
     output << ".global " << kalloc->name + 1 
     << endl
     << kalloc->name + 1 << ":" << endl;
-    if (kalloc->kind.data.global_alloc.init->kind.tag == KOOPA_RVT_ZERO_INIT) {
-
-        output << "    .zero " << calc_type_size(kalloc->ty->data.pointer.base) << endl;
+    if (const ConstInit *init = ConstInit::Find(kalloc->name))
+        emit_words(init->data.data(), init->data.size());
+    else {
+        vector<int32_t> words;
+        Visit_aggregate(kalloc->kind.data.global_alloc.init, words);
+        emit_words(words.data(), words.size());
     }
-    else if(kalloc->kind.data.global_alloc.init->kind.tag == KOOPA_RVT_AGGREGATE)
-        Visit_aggregate(kalloc->kind.data.global_alloc.init);
-    else
-        output << "    .word " << kalloc->kind.data.global_alloc.init->kind.data.integer.value << endl;
 }
 
 void koopa2RISCV::Visit_load(const koopa_raw_load_t *kload, int addr) {
     output << endl;
 
     if(kload->src->kind.tag == KOOPA_RVT_GET_ELEM_PTR || kload->src->kind.tag == KOOPA_RVT_GET_PTR) {
-        Load(kload->src, "t0");
-        output << "    lw t0, 0(t0)" << endl;
+        string src = mem_operand(kload->src, "t0");
+        output << "    lw t0, " << src << endl;
         Store(addr, "t0");
     }
     else {
@@ -100,10 +565,8 @@ void koopa2RISCV::Visit_store(const koopa_raw_store_t *kstore) {
         output << "    la t1, " << sto_dest->name + 1 << endl;
         dest = "(t1)";
     }
-    else if(sto_dest->kind.tag == KOOPA_RVT_GET_ELEM_PTR || sto_dest->kind.tag == KOOPA_RVT_GET_PTR) {
-        Load(sto_dest, "t1");
-        dest = "(t1)";
-    }
+    else if(sto_dest->kind.tag == KOOPA_RVT_GET_ELEM_PTR || sto_dest->kind.tag == KOOPA_RVT_GET_PTR)
+        dest = mem_operand(sto_dest, "t1");
     else {
         int addr = env.addr(sto_dest);
         if(addr < -2048 || addr > 2047) {
@@ -134,139 +597,482 @@ void koopa2RISCV::Visit_store(const koopa_raw_store_t *kstore) {
         }
     }
     else {
-        Load(sto_value, "t0");
-        output << "    sw t0, " << dest << endl;
+        string src = operand_reg(sto_value, "t0");
+        output << "    sw " << src << ", " << dest << endl;
     }
 }
 
-void koopa2RISCV::Visit_get_ptr(const koopa_raw_get_ptr_t *kget, int addr) {
-    output << endl;
-
-    int src_addr = env.addr(kget->src);
-    /*
-    if(src_addr > 2047 || src_addr < -2048)
-    {
-        output << "    li t0, " << src_addr << endl;
-        output << "    add t0, sp, t0" << endl;
-    }
-    else
-        output << "    addi t0, sp, " << src_addr << endl;
-    output << "    lw t0, 0(t0)" << endl;
-    */
-
-    Load(src_addr, "t0");
-    Load(kget->index, "t1");
-    int n = calc_type_size(kget->src->ty->data.pointer.base);
-    output << "    li t2, " << n << endl;
-    output << "    mul t1, t1, t2" << endl;
-    output << "    add t0, t0, t1" << endl;
-    Store(addr, "t0");
-}
-
-void koopa2RISCV::Visit_get_elem_ptr(const koopa_raw_get_elem_ptr_t *kget, int addr) {
-    output << endl;
-
-    if(kget->src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
-        output << "    la t0, " << kget->src->name + 1 << endl;
-    else {
-        int src_addr = env.addr(kget->src);
-        if(src_addr > 2047 || src_addr < -2048)
-        {
+//
+// t0 = src + index * stride, stored to `addr`.
+//
+// A constant index is folded into an `addi`, a power of two stride is a shift (or, with
+// Zba, a single `shNadd`), anything else needs `mul`.
+void koopa2RISCV::index_address(koopa_raw_value_t src, koopa_raw_value_t index, size_t stride, int addr) {
+    if (src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
+        output << "    la t0, " << src->name + 1 << endl;
+    else if (src->kind.tag == KOOPA_RVT_ALLOC) {
+        int src_addr = env.addr(src);
+        if (src_addr > 2047 || src_addr < -2048) {
             output << "    li t0, " << src_addr << endl;
             output << "    add t0, sp, t0" << endl;
         }
         else
             output << "    addi t0, sp, " << src_addr << endl;
-        if(kget->src->kind.tag == KOOPA_RVT_GET_ELEM_PTR || kget->src->kind.tag == KOOPA_RVT_GET_PTR)
-            output << "    lw t0, 0(t0)" << endl;
     }
-    Load(kget->index, "t1");
-    int n = calc_type_size(kget->src->ty->data.pointer.base->data.array.base);
-    output << "    li t2, " << n << endl;
-    output << "    mul t1, t1, t2" << endl;
+    else
+        Load(src, "t0");
+
+    if (index->kind.tag == KOOPA_RVT_INTEGER) {
+        int offset = index->kind.data.integer.value * (int)stride;
+        if (offset < -2048 || offset > 2047) {
+            output << "    li t1, " << offset << endl;
+            output << "    add t0, t0, t1" << endl;
+        }
+        else if (offset != 0)
+            output << "    addi t0, t0, " << offset << endl;
+        Store(addr, "t0");
+        return;
+    }
+    Load(index, "t1");
+    int shift = -1;
+    if (stride != 0 && (stride & (stride - 1)) == 0)
+        for (shift = 0; (1u << shift) != stride; ++shift);
+    if (opts.zba && shift >= 1 && shift <= 3) {
+        output << "    sh" << shift << "add t0, t1, t0" << endl;
+        Store(addr, "t0");
+        return;
+    }
+    if (shift > 0)
+        output << "    slli t1, t1, " << shift << endl;
+    else if (shift < 0) {
+        output << "    li t2, " << stride << endl;
+        output << "    mul t1, t1, t2" << endl;
+    }
     output << "    add t0, t0, t1" << endl;
     Store(addr, "t0");
 }
 
-void koopa2RISCV::Visit_binary(const koopa_raw_binary_t *kbinary, int addr) {
+void koopa2RISCV::Visit_get_ptr(const koopa_raw_get_ptr_t *kget, int addr) {
     output << endl;
+    index_address(kget->src, kget->index, calc_type_size(kget->src->ty->data.pointer.base), addr);
+}
 
-    Load(kbinary->lhs, "t0");
-    Load(kbinary->rhs, "t1");
-    switch (kbinary->op) {
-    case KOOPA_RBO_NOT_EQ:
-        output << "    xor t0, t0, t1" << endl;
-        output << "    snez t0, t0" << endl;
-        break;
-    case KOOPA_RBO_EQ:
-        output << "    xor t0, t0, t1" << endl;
-        output << "    seqz t0, t0" << endl;
-        break;
-    case KOOPA_RBO_GT:
-        output << "    sgt t0, t0, t1" << endl;
-        break;
+void koopa2RISCV::Visit_get_elem_ptr(const koopa_raw_get_elem_ptr_t *kget, int addr) {
+    output << endl;
+    index_address(kget->src, kget->index, calc_type_size(kget->src->ty->data.pointer.base->data.array.base), addr);
+}
+
+//
+// Register holding `kval` for an instruction operand: `x0` for the constant 0, otherwise
+// `reg` after loading `kval` to it.
+//
+string koopa2RISCV::operand_reg(koopa_raw_value_t kval, const string &reg) {
+    if (kval->kind.tag == KOOPA_RVT_INTEGER && kval->kind.data.integer.value == 0)
+        return "x0";
+    Load(kval, reg);
+    return reg;
+}
+
+static bool is_imm12(int64_t v) {
+    return v >= -2048 && v <= 2047;
+}
+//
+// Binary operation with a constant operand in the immediate form (`addi`, `andi`, `ori`,
+// `xori`, `slti`, `slli`/`srli`/`srai`), result in t0. For commutative operators the constant
+// may also be the lhs. Returns false if there is no such form, nothing is emitted then.
+//
+bool koopa2RISCV::binary_imm(const koopa_raw_binary_t *kbinary) {
+    koopa_raw_value_t lhs = kbinary->lhs, rhs = kbinary->rhs;
+    koopa_raw_binary_op_t op = kbinary->op;
+    bool commutative = op == KOOPA_RBO_ADD || op == KOOPA_RBO_AND || op == KOOPA_RBO_OR ||
+                       op == KOOPA_RBO_XOR || op == KOOPA_RBO_EQ || op == KOOPA_RBO_NOT_EQ;
+    if (rhs->kind.tag != KOOPA_RVT_INTEGER && commutative)
+        std::swap(lhs, rhs);
+    if (rhs->kind.tag != KOOPA_RVT_INTEGER)
+        return false;
+    int64_t imm = rhs->kind.data.integer.value;
+    switch (op) {
+    case KOOPA_RBO_ADD:
+    case KOOPA_RBO_AND:
+    case KOOPA_RBO_OR:
+    case KOOPA_RBO_XOR:
     case KOOPA_RBO_LT:
-        output << "    slt t0, t0, t1" << endl;
+        if (!is_imm12(imm))
+            return false;
         break;
+    case KOOPA_RBO_SUB:
     case KOOPA_RBO_GE:
-        output << "    slt t0, t0, t1" << endl;
-        output << "    xori t0, t0, 1" << endl;
+        if (!is_imm12(op == KOOPA_RBO_SUB ? -imm : imm))
+            return false;
         break;
     case KOOPA_RBO_LE:
-        output << "    sgt t0, t0, t1" << endl;
-        output << "    xori t0, t0, 1" << endl;
-        break;
-    case KOOPA_RBO_ADD:
-        output << "    add t0, t0, t1" << endl;
+    case KOOPA_RBO_GT:
+        // x <= c 即 x < c + 1
+        if (!is_imm12(imm + 1))
+            return false;
         break;
-    case KOOPA_RBO_SUB:
-        output << "    sub t0, t0, t1" << endl;
+    case KOOPA_RBO_EQ:
+    case KOOPA_RBO_NOT_EQ:
+        if (imm != 0 && !is_imm12(imm))
+            return false;
         break;
-    case KOOPA_RBO_MUL:
-        output << "    mul t0, t0, t1" << endl;
+    case KOOPA_RBO_SHL:
+    case KOOPA_RBO_SHR:
+    case KOOPA_RBO_SAR:
+        imm &= 31;
         break;
-    case KOOPA_RBO_DIV:
-        output << "    div t0, t0, t1" << endl;
+    default:
+        return false;
+    }
+
+    string src = operand_reg(lhs, "t0");
+    switch (op) {
+    case KOOPA_RBO_ADD:
+        output << "    addi t0, " << src << ", " << imm << endl;
         break;
-    case KOOPA_RBO_MOD:
-        output << "    rem t0, t0, t1" << endl;
+    case KOOPA_RBO_SUB:
+        output << "    addi t0, " << src << ", " << -imm << endl;
         break;
     case KOOPA_RBO_AND:
-        output << "    and t0, t0, t1" << endl;
+        output << "    andi t0, " << src << ", " << imm << endl;
         break;
     case KOOPA_RBO_OR:
-        output << "    or t0, t0, t1" << endl;
+        output << "    ori t0, " << src << ", " << imm << endl;
         break;
     case KOOPA_RBO_XOR:
-        output << "    xor t0, t0, t1" << endl;
+        output << "    xori t0, " << src << ", " << imm << endl;
+        break;
+    case KOOPA_RBO_LT:
+        output << "    slti t0, " << src << ", " << imm << endl;
+        break;
+    case KOOPA_RBO_GE:
+        output << "    slti t0, " << src << ", " << imm << endl;
+        output << "    xori t0, t0, 1" << endl;
+        break;
+    case KOOPA_RBO_LE:
+        output << "    slti t0, " << src << ", " << imm + 1 << endl;
+        break;
+    case KOOPA_RBO_GT:
+        output << "    slti t0, " << src << ", " << imm + 1 << endl;
+        output << "    xori t0, t0, 1" << endl;
+        break;
+    case KOOPA_RBO_EQ:
+    case KOOPA_RBO_NOT_EQ:
+        if (imm != 0) {
+            output << "    xori t0, " << src << ", " << imm << endl;
+            src = "t0";
+        }
+        output << (op == KOOPA_RBO_EQ ? "    seqz t0, " : "    snez t0, ") << src << endl;
         break;
     case KOOPA_RBO_SHL:
-        output << "    sll t0, t0, t1" << endl;
+        output << "    slli t0, " << src << ", " << imm << endl;
         break;
     case KOOPA_RBO_SHR:
-        output << "    srl t0, t0, t1" << endl;
+        output << "    srli t0, " << src << ", " << imm << endl;
         break;
     case KOOPA_RBO_SAR:
-        output << "    sra t0, t0, t1" << endl;
+        output << "    srai t0, " << src << ", " << imm << endl;
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+//
+// Magic number for signed division by `d` (|d| >= 2), from Hacker's Delight 10-1:
+// x / d == (mulh(x, magic) (+ or - x) >> shift) + sign bit of that.
+//
+static void div_magic(int32_t d, int32_t &magic, int &shift) {
+    const uint32_t two31 = 0x80000000u;
+    uint32_t ad = d < 0 ? -(uint32_t)d : d;
+    uint32_t t = two31 + ((uint32_t)d >> 31);
+    uint32_t anc = t - 1 - t % ad;
+    int p = 31;
+    uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+    uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+    uint32_t delta;
+    do {
+        ++p;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            ++q1;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            ++q2;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    magic = (int32_t)(q2 + 1);
+    if (d < 0)
+        magic = -magic;
+    shift = p - 32;
+}
+
+static int log2_exact(uint32_t v) {
+    if (v == 0 || (v & (v - 1)) != 0)
+        return -1;
+    int k = 0;
+    while ((1u << k) != v)
+        ++k;
+    return k;
+}
+//
+// Multiplication, division and remainder by a constant without `mul`/`div`/`rem` where a
+// shorter sequence exists, result in t0. Returns false (nothing emitted) otherwise.
+//
+// x * c: shifts plus one add/sub for c = 2^k, 2^k ± 1 and 2^j + 2^k (Zba: sh1add/sh2add/
+// sh3add for 3, 5, 9), negated for negative c.
+// x / c: arithmetic shift with rounding towards zero for c = ±2^k, `mulh` with a magic
+// number otherwise. x % c: x - (x / c) * c, or a mask for c = ±2^k.
+//
+bool koopa2RISCV::binary_muldiv_const(const koopa_raw_binary_t *kbinary) {
+    koopa_raw_value_t lhs = kbinary->lhs, rhs = kbinary->rhs;
+    koopa_raw_binary_op_t op = kbinary->op;
+    if (op == KOOPA_RBO_MUL && rhs->kind.tag != KOOPA_RVT_INTEGER)
+        std::swap(lhs, rhs);
+    if (rhs->kind.tag != KOOPA_RVT_INTEGER)
+        return false;
+    int32_t c = rhs->kind.data.integer.value;
+    uint32_t ac = c < 0 ? -(uint32_t)c : c;
+
+    if (op == KOOPA_RBO_MUL) {
+        if (c == INT32_MIN)
+            return false;
+        const char *shadd[4] = {nullptr, "sh1add", "sh2add", "sh3add"};
+        int k = log2_exact(ac), k_plus = log2_exact(ac - 1), k_minus = log2_exact(ac + 1);
+        uint32_t low = ac & -ac;
+        int j = log2_exact(low), k_high = log2_exact(ac - low);
+        if (c == 0) {
+            output << "    li t0, 0" << endl;
+            return true;
+        }
+        Load(lhs, "t0");
+        if (k >= 0) {
+            if (k > 0)
+                output << "    slli t0, t0, " << k << endl;
+        }
+        else if (opts.zba && k_plus >= 1 && k_plus <= 3)
+            output << "    " << shadd[k_plus] << " t0, t0, t0" << endl;
+        else if (k_plus > 0) {
+            output << "    slli t1, t0, " << k_plus << endl;
+            output << "    add t0, t1, t0" << endl;
+        }
+        else if (k_minus > 0) {
+            output << "    slli t1, t0, " << k_minus << endl;
+            output << "    sub t0, t1, t0" << endl;
+        }
+        else if (k_high > 0) {
+            output << "    slli t1, t0, " << k_high << endl;
+            if (j > 0)
+                output << "    slli t0, t0, " << j << endl;
+            output << "    add t0, t1, t0" << endl;
+        }
+        else {
+            output << "    li t1, " << c << endl;
+            output << "    mul t0, t0, t1" << endl;
+            return true;
+        }
+        if (c < 0)
+            output << "    neg t0, t0" << endl;
+        return true;
+    }
+
+    if (op != KOOPA_RBO_DIV && op != KOOPA_RBO_MOD)
+        return false;
+    // 除以 0 保持原样; INT32_MIN 没有对应的正数, 交给 div/rem
+    if (c == 0 || c == INT32_MIN)
+        return false;
+    Load(lhs, "t0");
+    if (ac == 1) {
+        if (op == KOOPA_RBO_MOD)
+            output << "    li t0, 0" << endl;
+        else if (c < 0)
+            output << "    neg t0, t0" << endl;
+        return true;
+    }
+    int k = log2_exact(ac);
+    if (k > 0) {
+        // 负数先加上 2^k - 1, 使移位向零取整
+        if (k == 1)
+            output << "    srli t1, t0, 31" << endl;
+        else {
+            output << "    srai t1, t0, 31" << endl;
+            output << "    srli t1, t1, " << 32 - k << endl;
+        }
+        output << "    add t1, t0, t1" << endl;
+        if (op == KOOPA_RBO_DIV) {
+            output << "    srai t0, t1, " << k << endl;
+            if (c < 0)
+                output << "    neg t0, t0" << endl;
+        }
+        else {
+            if (is_imm12(-(int64_t)ac))
+                output << "    andi t1, t1, " << -(int64_t)ac << endl;
+            else {
+                output << "    li t2, " << -(int64_t)ac << endl;
+                output << "    and t1, t1, t2" << endl;
+            }
+            output << "    sub t0, t0, t1" << endl;
+        }
+        return true;
+    }
+    int32_t magic;
+    int shift;
+    div_magic(c, magic, shift);
+    output << "    li t1, " << magic << endl;
+    output << "    mulh t1, t0, t1" << endl;
+    if (c > 0 && magic < 0)
+        output << "    add t1, t1, t0" << endl;
+    else if (c < 0 && magic > 0)
+        output << "    sub t1, t1, t0" << endl;
+    if (shift > 0)
+        output << "    srai t1, t1, " << shift << endl;
+    output << "    srli t2, t1, 31" << endl;
+    output << "    add t1, t1, t2" << endl;
+    if (op == KOOPA_RBO_DIV)
+        output << "    mv t0, t1" << endl;
+    else {
+        output << "    li t2, " << c << endl;
+        output << "    mul t1, t1, t2" << endl;
+        output << "    sub t0, t0, t1" << endl;
+    }
+    return true;
+}
+
+void koopa2RISCV::Visit_binary(const koopa_raw_binary_t *kbinary, int addr) {
+    output << endl;
+
+    if (binary_imm(kbinary) || binary_muldiv_const(kbinary)) {
+        Store(addr, "t0");
+        return;
+    }
+    // 常量 0 直接用 x0, 于是 0 - x 即 neg, 0 == x 已在上面成为 seqz
+    string lhs = operand_reg(kbinary->lhs, "t0");
+    string rhs = operand_reg(kbinary->rhs, "t1");
+    const char *inst = nullptr;
+    switch (kbinary->op) {
+    case KOOPA_RBO_NOT_EQ:
+        output << "    xor t0, " << lhs << ", " << rhs << endl;
+        output << "    snez t0, t0" << endl;
+        break;
+    case KOOPA_RBO_EQ:
+        output << "    xor t0, " << lhs << ", " << rhs << endl;
+        output << "    seqz t0, t0" << endl;
+        break;
+    case KOOPA_RBO_GE:
+        output << "    slt t0, " << lhs << ", " << rhs << endl;
+        output << "    xori t0, t0, 1" << endl;
+        break;
+    case KOOPA_RBO_LE:
+        output << "    sgt t0, " << lhs << ", " << rhs << endl;
+        output << "    xori t0, t0, 1" << endl;
         break;
+    case KOOPA_RBO_SUB:
+        if (lhs == "x0")
+            output << "    neg t0, " << rhs << endl;
+        else
+            output << "    sub t0, " << lhs << ", " << rhs << endl;
+        break;
+    case KOOPA_RBO_GT:  inst = "sgt"; break;
+    case KOOPA_RBO_LT:  inst = "slt"; break;
+    case KOOPA_RBO_ADD: inst = "add"; break;
+    case KOOPA_RBO_MUL: inst = "mul"; break;
+    case KOOPA_RBO_DIV: inst = "div"; break;
+    case KOOPA_RBO_MOD: inst = "rem"; break;
+    case KOOPA_RBO_AND: inst = "and"; break;
+    case KOOPA_RBO_OR:  inst = "or"; break;
+    case KOOPA_RBO_XOR: inst = "xor"; break;
+    case KOOPA_RBO_SHL: inst = "sll"; break;
+    case KOOPA_RBO_SHR: inst = "srl"; break;
+    case KOOPA_RBO_SAR: inst = "sra"; break;
     }
+    if (inst)
+        output << "    " << inst << " t0, " << lhs << ", " << rhs << endl;
     Store(addr, "t0");
 }
 
+//
+// Whether `kblk` is already emitted and close enough for a conditional branch (±4 KiB).
+//
+bool koopa2RISCV::near_block(koopa_raw_basic_block_t kblk) {
+    auto it = block_pos.find(kblk);
+    if (it == block_pos.end())
+        return false;
+    std::streamoff pos = output.tellp();
+    return pos >= 0 && pos - it->second < branch_range;
+}
+
 void koopa2RISCV::Visit_branch(const koopa_raw_branch_t *kbranch) {
     output << endl;
-    Load(kbranch->cond, "t0");
+    // 常量条件 (比如 while (1)) 就是无条件跳转
+    if (kbranch->cond->kind.tag == KOOPA_RVT_INTEGER) {
+        koopa_raw_basic_block_t target = kbranch->cond->kind.data.integer.value ? kbranch->true_bb : kbranch->false_bb;
+        if (target != next_block)
+            output << "    j " << current_func_name << "_" << target->name + 1 << endl;
+        return;
+    }
+    // 条件是只在这里用到的比较时直接比较两个操作数, 否则判断 t0 是否为零.
+    // `branch` 在条件成立时跳转, `inverse` 在条件不成立时跳转.
+    string branch = "bnez t0", inverse = "beqz t0";
+    if (fused_cmp.count(kbranch->cond)) {
+        const koopa_raw_binary_t &cmp = kbranch->cond->kind.data.binary;
+        string lhs = operand_reg(cmp.lhs, "t0");
+        string rhs = operand_reg(cmp.rhs, "t1");
+        const char *op = "", *inv_op = "";
+        switch (cmp.op) {
+        case KOOPA_RBO_EQ:     op = "beq"; inv_op = "bne"; break;
+        case KOOPA_RBO_NOT_EQ: op = "bne"; inv_op = "beq"; break;
+        case KOOPA_RBO_LT:     op = "blt"; inv_op = "bge"; break;
+        case KOOPA_RBO_GE:     op = "bge"; inv_op = "blt"; break;
+        case KOOPA_RBO_GT:     op = "bgt"; inv_op = "ble"; break;
+        case KOOPA_RBO_LE:     op = "ble"; inv_op = "bgt"; break;
+        default: break;
+        }
+        branch = string(op) + " " + lhs + ", " + rhs;
+        inverse = string(inv_op) + " " + lhs + ", " + rhs;
+    }
+    else
+        Load(kbranch->cond, "t0");
     // output << "    bnez t0, " << current_func_name << "_" << kbranch->true_bb->name + 1 << endl;
+    // 向回跳且距离够近时直接用条件分支, 比如旋转后的循环回到循环体
+    if (near_block(kbranch->true_bb)) {
+        output << "    " << branch << ", " << current_func_name << "_" << kbranch->true_bb->name + 1 << endl;
+        if (kbranch->false_bb != next_block)
+            output << "    j " << current_func_name << "_" << kbranch->false_bb->name + 1 << endl;
+        return;
+    }
+    if (near_block(kbranch->false_bb)) {
+        output << "    " << inverse << ", " << current_func_name << "_" << kbranch->false_bb->name + 1 << endl;
+        if (kbranch->true_bb != next_block)
+            output << "    j " << current_func_name << "_" << kbranch->true_bb->name + 1 << endl;
+        return;
+    }
     // 解决跳转超限问题
-    output << "    beqz t0, " << current_func_name << "_skip_" << jump_index << endl;
+    // 紧跟在后面的块不用跳转
+    if (kbranch->true_bb == next_block) {
+        output << "    " << branch << ", " << current_func_name << "_skip_" << jump_index << endl;
+        output << "    j " << current_func_name << "_" << kbranch->false_bb->name + 1 << endl;
+        output << current_func_name << "_skip_" << jump_index++ << ":" << endl;
+        return;
+    }
+    output << "    " << inverse << ", " << current_func_name << "_skip_" << jump_index << endl;
     output << "    j " << current_func_name << "_" << kbranch->true_bb->name + 1 << endl;
     output << current_func_name << "_skip_" << jump_index++ << ":" << endl;
 
-    output << "    j " << current_func_name << "_" << kbranch->false_bb->name + 1 << endl;
+    if (kbranch->false_bb != next_block)
+        output << "    j " << current_func_name << "_" << kbranch->false_bb->name + 1 << endl;
 }
 
 void koopa2RISCV::Visit_jump(const koopa_raw_jump_t *kjump) {
-    output << endl << "    j " << current_func_name << "_" << kjump->target->name + 1 << endl;
+    output << endl;
+    if (kjump->target != next_block)
+        output << "    j " << current_func_name << "_" << kjump->target->name + 1 << endl;
 }
 
 void koopa2RISCV::Visit_call(const koopa_raw_call_t *kcall, int addr) {
@@ -288,6 +1094,8 @@ void koopa2RISCV::Visit_call(const koopa_raw_call_t *kcall, int addr) {
         }
     }
     output << "    call " << kcall->callee->name + 1 << endl;
+    if (strncmp(kcall->callee->name + 1, "__sysy_mem", 10) == 0)
+        runtime_calls.insert(kcall->callee->name + 1);
     if (addr != -1)
         Store(addr, "a0");
 }
@@ -295,6 +1103,9 @@ void koopa2RISCV::Visit_call(const koopa_raw_call_t *kcall, int addr) {
 void koopa2RISCV::Visit_return(const koopa_raw_return_t *kret) {
     output << endl;
 
+    // 调用会破坏 a0, 所以先输出 profile 再装载返回值
+    if (opts.instrument && strcmp(current_func_name, "main") == 0)
+        output << "    call __sysy_prof_dump" << endl;
     if (kret->value)
         Load(kret->value, "a0");
     int sz = env.size();
@@ -317,12 +1128,18 @@ void koopa2RISCV::gen_riscv_func(koopa_raw_function_t kfunc) {
     if(kfunc->bbs.len == 0)
         return;
     const char *name = kfunc->name + 1;
+    PhaseScope phase("gen_riscv_func", name);
     output << ".globl " << name 
     << endl
     << name << ":" << endl;
 
-    bool has_call = false;
-    int func_size = calc_func_size(kfunc, has_call);
+    // 插桩时 main 要调用 `__sysy_prof_dump`, 需要保存 ra
+    bool has_call = opts.instrument && strcmp(name, "main") == 0;
+    int func_size;
+    {
+        PhaseScope phase("frame layout");
+        func_size = calc_func_size(kfunc, has_call);
+    }
     if(func_size != 0) {
         func_size = ((func_size - 1) / 16 + 1) * 16;
         if(-func_size < -2048 || -func_size > 2047) {
@@ -346,7 +1163,84 @@ void koopa2RISCV::gen_riscv_func(koopa_raw_function_t kfunc) {
     env.current -= has_call ? 4 : 0;
     // blocks
     current_func_name = kfunc->name + 1;
-    traversal_raw_slice(&kfunc->bbs);
+    calc_static_addr(kfunc);
+    calc_fused_cmp(kfunc);
+    calc_vector_loops(kfunc);
+    block_pos.clear();
+    if (opts.instrument)
+        prof_funcs.emplace_back(name, kfunc->bbs.len);
+
+    // blocks, in the order of `bbs` unless a profile says otherwise
+    vector<size_t> order;
+    const vector<uint64_t> *counts = opts.profile ? opts.profile->Find(name) : nullptr;
+    if (counts && counts->size() == kfunc->bbs.len)
+        order = block_layout(kfunc, *counts);
+    else {
+        if (counts)
+            std::cerr << "profile of " << name << " does not match its blocks, ignored" << endl;
+        for (size_t i = 0; i < kfunc->bbs.len; ++i)
+            order.push_back(i);
+    }
+    for (size_t i = 0; i < order.size(); ++i) {
+        block_index = order[i];
+        next_block = i + 1 < order.size() ? (koopa_raw_basic_block_t)kfunc->bbs.buffer[order[i + 1]] : nullptr;
+        gen_riscv_block((koopa_raw_basic_block_t)kfunc->bbs.buffer[block_index]);
+    }
+}
+
+//
+// Profile guided block order (indices into `bbs`).
+//
+// Chains are grown greedily from the entry block: after a block comes its hottest
+// successor which is not placed yet, so the likely edge of every branch falls through.
+// When a chain ends, the next one starts at the hottest remaining block. Blocks which never
+// ran go to the end of the function in their original order.
+//
+vector<size_t> koopa2RISCV::block_layout(koopa_raw_function_t kfunc, const vector<uint64_t> &counts) {
+    size_t n = kfunc->bbs.len;
+    map<koopa_raw_basic_block_t, size_t> index;
+    for (size_t i = 0; i < n; ++i)
+        index[(koopa_raw_basic_block_t)kfunc->bbs.buffer[i]] = i;
+    vector<bool> placed(n, false);
+    vector<size_t> order;
+
+    size_t cur = 0;
+    for (;;) {
+        placed[cur] = true;
+        order.push_back(cur);
+        // successors from the terminator
+        koopa_raw_basic_block_t kblk = (koopa_raw_basic_block_t)kfunc->bbs.buffer[cur];
+        vector<koopa_raw_basic_block_t> succ;
+        if (kblk->insts.len > 0) {
+            koopa_raw_value_t term = (koopa_raw_value_t)kblk->insts.buffer[kblk->insts.len - 1];
+            if (term->kind.tag == KOOPA_RVT_BRANCH) {
+                succ.push_back(term->kind.data.branch.true_bb);
+                succ.push_back(term->kind.data.branch.false_bb);
+            }
+            else if (term->kind.tag == KOOPA_RVT_JUMP)
+                succ.push_back(term->kind.data.jump.target);
+        }
+        int next = -1;
+        for (auto s : succ) {
+            auto it = index.find(s);
+            if (it == index.end() || placed[it->second] || counts[it->second] == 0)
+                continue;
+            if (next < 0 || counts[it->second] > counts[next])
+                next = it->second;
+        }
+        if (next < 0) {
+            for (size_t i = 0; i < n; ++i)
+                if (!placed[i] && counts[i] > 0 && (next < 0 || counts[i] > counts[next]))
+                    next = i;
+        }
+        if (next < 0)
+            break;
+        cur = next;
+    }
+    for (size_t i = 0; i < n; ++i)
+        if (!placed[i])
+            order.push_back(i);
+    return order;
 }
 
 void koopa2RISCV::gen_riscv_block(koopa_raw_basic_block_t kblk)
@@ -354,7 +1248,21 @@ void koopa2RISCV::gen_riscv_block(koopa_raw_basic_block_t kblk)
     //TODO: params
     //TODO: used_by
     output << endl;
+    block_pos[kblk] = output.tellp();
     output << current_func_name << "_" << kblk->name + 1 << ":" << endl;
+    if (opts.instrument) {
+        // 块入口处所有值都在栈上, t0/t1 可以随意使用
+        int offset = block_index * 4;
+        output << "    la t0, __prof_" << current_func_name << endl;
+        if (offset > 2047) {
+            output << "    li t1, " << offset << endl;
+            output << "    add t0, t0, t1" << endl;
+            offset = 0;
+        }
+        output << "    lw t1, " << offset << "(t0)" << endl;
+        output << "    addi t1, t1, 1" << endl;
+        output << "    sw t1, " << offset << "(t0)" << endl;
+    }
     traversal_raw_slice(&kblk->insts);
 }
 
@@ -366,9 +1274,12 @@ void koopa2RISCV::gen_riscv_value(koopa_raw_value_t kval) {
     case KOOPA_RVT_ZERO_INIT:
     case KOOPA_RVT_UNDEF:
         break;
-    case KOOPA_RVT_AGGREGATE:
-        Visit_aggregate(kval);
+    case KOOPA_RVT_AGGREGATE: {
+        vector<int32_t> words;
+        Visit_aggregate(kval, words);
+        emit_words(words.data(), words.size());
         break;
+    }
     case KOOPA_RVT_FUNC_ARG_REF:
     case KOOPA_RVT_BLOCK_ARG_REF:
     case KOOPA_RVT_ALLOC:
@@ -383,20 +1294,28 @@ void koopa2RISCV::gen_riscv_value(koopa_raw_value_t kval) {
         Visit_store(&kval->kind.data.store);
         break;
     case KOOPA_RVT_GET_PTR:
-        Visit_get_ptr(&kval->kind.data.get_ptr, addr);
+        if (!static_addr.count(kval) && !zero_offset_src(kval))
+            Visit_get_ptr(&kval->kind.data.get_ptr, addr);
         break;
     case KOOPA_RVT_GET_ELEM_PTR:
-        Visit_get_elem_ptr(&kval->kind.data.get_elem_ptr, addr);
+        if (!static_addr.count(kval) && !zero_offset_src(kval))
+            Visit_get_elem_ptr(&kval->kind.data.get_elem_ptr, addr);
         break;
     case KOOPA_RVT_BINARY:
-        Visit_binary(&kval->kind.data.binary, addr);
+        if (!fused_cmp.count(kval))
+            Visit_binary(&kval->kind.data.binary, addr);
         break;
     case KOOPA_RVT_BRANCH:
-        Visit_branch(&kval->kind.data.branch);
-        break;
-    case KOOPA_RVT_JUMP:
-        Visit_jump(&kval->kind.data.jump);
+    case KOOPA_RVT_JUMP: {
+        auto vec_it = vector_loops.find(kval);
+        if (vec_it != vector_loops.end())
+            emit_vector_loop(vec_it->second);
+        if (kval->kind.tag == KOOPA_RVT_BRANCH)
+            Visit_branch(&kval->kind.data.branch);
+        else
+            Visit_jump(&kval->kind.data.jump);
         break;
+    }
     case KOOPA_RVT_CALL:
         Visit_call(&kval->kind.data.call, kval->ty->tag == KOOPA_RTT_UNIT ? -1 : addr);
         break;
@@ -425,10 +1344,129 @@ void koopa2RISCV::traversal_raw_slice(const koopa_raw_slice_t *rs) {
 }
 
 void koopa2RISCV::build(const koopa_raw_program_t *raw) {
-    output << ".data" << endl;
-    traversal_raw_slice(&raw->values);
+    {
+        PhaseScope phase("global data");
+        output << ".data" << endl;
+        vector<koopa_raw_value_t> zero_globals;
+        for (uint32_t i = 0; i < raw->values.len; ++i) {
+            koopa_raw_value_t kalloc = (koopa_raw_value_t)raw->values.buffer[i];
+            if (is_zero_global(kalloc))
+                zero_globals.push_back(kalloc);
+            else
+                Visit_global_alloc(kalloc);
+        }
+        // 全零的全局变量放在 .bss, 不占可执行文件的空间
+        if (!zero_globals.empty())
+            output << ".bss" << endl;
+        for (koopa_raw_value_t kalloc : zero_globals) {
+            output << ".global " << kalloc->name + 1 << endl
+            << kalloc->name + 1 << ":" << endl;
+            output << "    .zero " << calc_type_size(kalloc->ty->data.pointer.base) << endl;
+        }
+    }
+    PhaseScope phase("functions");
     output << ".text" << endl;
     traversal_raw_slice(&raw->funcs);
+    emit_runtime();
+    if (opts.instrument)
+        emit_prof_dump();
+}
+
+//
+// Emit the routines of the compiler's runtime the program calls, leaf functions which only
+// use the argument and temporary registers:
+//
+//     __sysy_memset32(int *p, int v, int n)      p[0 .. n) = v
+//     __sysy_memcpy32(int *d, int *s, int n)     d[0 .. n) = s[0 .. n), not overlapping
+//
+// Both handle 8 words per iteration, then the rest one by one; nothing is done for n <= 0.
+//
+void koopa2RISCV::emit_runtime() {
+    if (runtime_calls.count("__sysy_memset32")) {
+        output << endl << ".globl __sysy_memset32" << endl;
+        output << "__sysy_memset32:" << endl;
+        output << "    li t0, 8" << endl;
+        output << "    blt a2, t0, __sysy_memset32_rest" << endl;
+        output << "__sysy_memset32_8:" << endl;
+        for (int k = 0; k < 8; ++k)
+            output << "    sw a1, " << k * 4 << "(a0)" << endl;
+        output << "    addi a0, a0, 32" << endl;
+        output << "    addi a2, a2, -8" << endl;
+        output << "    bge a2, t0, __sysy_memset32_8" << endl;
+        output << "__sysy_memset32_rest:" << endl;
+        output << "    blez a2, __sysy_memset32_end" << endl;
+        output << "    sw a1, 0(a0)" << endl;
+        output << "    addi a0, a0, 4" << endl;
+        output << "    addi a2, a2, -1" << endl;
+        output << "    j __sysy_memset32_rest" << endl;
+        output << "__sysy_memset32_end:" << endl;
+        output << "    ret" << endl;
+    }
+    if (runtime_calls.count("__sysy_memcpy32")) {
+        static const char *const regs[] = {"t0", "t1", "t2", "t3", "t4", "t5", "t6", "a3"};
+        output << endl << ".globl __sysy_memcpy32" << endl;
+        output << "__sysy_memcpy32:" << endl;
+        output << "    li a4, 8" << endl;
+        output << "    blt a2, a4, __sysy_memcpy32_rest" << endl;
+        output << "__sysy_memcpy32_8:" << endl;
+        for (int k = 0; k < 8; ++k)
+            output << "    lw " << regs[k] << ", " << k * 4 << "(a1)" << endl;
+        for (int k = 0; k < 8; ++k)
+            output << "    sw " << regs[k] << ", " << k * 4 << "(a0)" << endl;
+        output << "    addi a0, a0, 32" << endl;
+        output << "    addi a1, a1, 32" << endl;
+        output << "    addi a2, a2, -8" << endl;
+        output << "    bge a2, a4, __sysy_memcpy32_8" << endl;
+        output << "__sysy_memcpy32_rest:" << endl;
+        output << "    blez a2, __sysy_memcpy32_end" << endl;
+        output << "    lw t0, 0(a1)" << endl;
+        output << "    sw t0, 0(a0)" << endl;
+        output << "    addi a0, a0, 4" << endl;
+        output << "    addi a1, a1, 4" << endl;
+        output << "    addi a2, a2, -1" << endl;
+        output << "    j __sysy_memcpy32_rest" << endl;
+        output << "__sysy_memcpy32_end:" << endl;
+        output << "    ret" << endl;
+    }
+}
+
+//
+// Emit the counter tables of -instrument and `__sysy_prof_dump`, which writes them with
+// the runtime's output functions:
+//
+//     #profile
+//     <function> <number of blocks>: <count of block 0> <count of block 1> ...
+//
+// one line per function, blocks in the order of `bbs`. The lines follow the program's own
+// output, so a reader of the profile skips everything up to the `#profile` line.
+//
+void koopa2RISCV::emit_prof_dump() {
+    output << endl << ".globl __sysy_prof_dump" << endl;
+    output << "__sysy_prof_dump:" << endl;
+    output << "    addi sp, sp, -16" << endl;
+    output << "    sw ra, 12(sp)" << endl;
+    auto put_str = [this](const string &str) {
+        for (char c : str) {
+            output << "    li a0, " << (int)c << endl;
+            output << "    call putch" << endl;
+        }
+    };
+    put_str("#profile\n");
+    for (auto &func : prof_funcs) {
+        put_str(func.first + " ");
+        output << "    li a0, " << func.second << endl;
+        output << "    la a1, __prof_" << func.first << endl;
+        output << "    call putarray" << endl;
+    }
+    output << "    lw ra, 12(sp)" << endl;
+    output << "    addi sp, sp, 16" << endl;
+    output << "    ret" << endl;
+
+    output << endl << ".bss" << endl;
+    for (auto &func : prof_funcs) {
+        output << "__prof_" << func.first << ":" << endl;
+        output << "    .zero " << func.second * 4 << endl;
+    }
 }
 
 
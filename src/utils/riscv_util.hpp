@@ -4,12 +4,33 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <set>
+#include <vector>
 
 #include <koopa.h>
 
-using std::ostream, std::endl, std::map, std::string;
+#include "opt/vectorize.hpp"
+#include "utils/profile.hpp"
+
+using std::ostream, std::endl, std::map, std::string, std::vector;
 
 class koopa2RISCV {
+public:
+    // 后端选项, 由命令行参数设置
+    struct Options {
+        // -instrument: 每个基本块入口给 `__prof_<函数名>` 表中对应的计数器加一,
+        // main 返回前由 `__sysy_prof_dump` 把所有表输出到 stdout, 格式见 `emit_prof_dump`.
+        bool instrument = false;
+        // -fprofile-use: 按基本块计数排列块的顺序, 热路径 fallthrough, 冷块放在函数末尾.
+        const ProfileData *profile = nullptr;
+        // -march=...zba...: 地址计算使用 Zba 的 sh1add/sh2add/sh3add
+        bool zba = false;
+        // -march=rv32gcv (rv32/rv64 后的单字母扩展里有 v): 能向量化的计数循环 (见 `VectorLoop`)
+        // 在进入循环前用 RVV 分段执行, 不满足条件时仍走原来的标量循环
+        bool rvv = false;
+    };
+
+private:
     class Env {
         // total size and address
         size_t _size;
@@ -51,6 +72,34 @@ class koopa2RISCV {
     Env env;
     const char *current_func_name;
     ostream &output;
+    Options opts;
+    // Index of the block being generated in `bbs` of the current function.
+    size_t block_index;
+    // The block emitted right after the current one, a jump to it can fall through.
+    koopa_raw_basic_block_t next_block;
+    // Output position of the label of every block emitted so far in the current function.
+    // A branch back to a block less than `branch_range` bytes of text away can reach it
+    // directly: no line of assembly is shorter than the machine code it becomes.
+    map<koopa_raw_basic_block_t, std::streamoff> block_pos;
+    static const std::streamoff branch_range = 4000;
+    // Pointers known at compile time: `sym + offset` of a global, or `sp + offset` if `sym` is
+    // nullptr. Such getelemptr/getptr are not computed, their uses address memory directly.
+    // Neither is a getelemptr/getptr with index 0 (`zero_offset_src`), its uses load `src`.
+    struct StaticAddr {
+        const char *sym;
+        int offset;
+    };
+    map<koopa_raw_value_t, StaticAddr> static_addr;
+    // Comparisons whose only use is the `br` ending their block. They are not computed,
+    // the branch compares the operands itself with `blt`/`bge`/`beq`/`bne`.
+    std::set<koopa_raw_value_t> fused_cmp;
+    // Loops run with RVV, by the branch ending their `pre`.
+    map<koopa_raw_value_t, VectorLoop> vector_loops;
+    // Routines of the compiler's runtime (`__sysy_memset32`, `__sysy_memcpy32`) called in the
+    // program, emitted after the functions by `emit_runtime`.
+    std::set<string> runtime_calls;
+    // Instrumented functions and their number of basic blocks.
+    vector<std::pair<string, size_t>> prof_funcs;
     // Some useful RISC-V code related functions.
     static size_t calc_func_size(koopa_raw_function_t kfunc, bool &has_call);
     static size_t calc_blk_size(koopa_raw_basic_block_t kblk, bool &has_call);
@@ -61,17 +110,33 @@ class koopa2RISCV {
     void gen_riscv_func(koopa_raw_function_t kfunc);
     void gen_riscv_block(koopa_raw_basic_block_t kblk);
     void gen_riscv_value(koopa_raw_value_t kval);
+    void emit_prof_dump();
+    void emit_runtime();
+    vector<size_t> block_layout(koopa_raw_function_t kfunc, const vector<uint64_t> &counts);
 
     void Load(koopa_raw_value_t kval, const string& reg);
     void Load(int addr, const string& reg);
     void Store(int addr, const string& reg);
-    void Visit_aggregate(koopa_raw_value_t kval);
+    static koopa_raw_value_t zero_offset_src(koopa_raw_value_t kval);
+    void calc_static_addr(koopa_raw_function_t kfunc);
+    void calc_fused_cmp(koopa_raw_function_t kfunc);
+    void calc_vector_loops(koopa_raw_function_t kfunc);
+    void emit_vector_loop(const VectorLoop &vl);
+    string mem_operand(koopa_raw_value_t ptr, const string &reg);
+    void index_address(koopa_raw_value_t src, koopa_raw_value_t index, size_t stride, int addr);
+    void Visit_aggregate(koopa_raw_value_t kval, vector<int32_t> &words);
+    void emit_words(const int32_t *words, size_t n);
+    bool is_zero_global(koopa_raw_value_t kalloc);
     void Visit_global_alloc(koopa_raw_value_t kalloc);
     void Visit_load(const koopa_raw_load_t *kload, int addr);
     void Visit_store(const koopa_raw_store_t *kstore);
     void Visit_get_ptr(const koopa_raw_get_ptr_t *kget, int addr);
     void Visit_get_elem_ptr(const koopa_raw_get_elem_ptr_t *kget, int addr);
+    string operand_reg(koopa_raw_value_t kval, const string &reg);
+    bool binary_imm(const koopa_raw_binary_t *kbinary);
+    bool binary_muldiv_const(const koopa_raw_binary_t *kbinary);
     void Visit_binary(const koopa_raw_binary_t *kbinary, int addr);
+    bool near_block(koopa_raw_basic_block_t kblk);
     void Visit_branch(const koopa_raw_branch_t *kbranch);
     void Visit_jump(const koopa_raw_jump_t *kjump);
     void Visit_call(const koopa_raw_call_t *kcall, int addr);
@@ -80,6 +145,7 @@ class koopa2RISCV {
 public:
     // 构造函数接受一个输出流参数，用于输出生成的RISC-V汇编代码。
     koopa2RISCV(ostream &_out) : output(_out) {}
+    koopa2RISCV(ostream &_out, const Options &_opts) : output(_out), opts(_opts) {}
     // build(raw)接受要转换的Koopa IR程序。
     void build(const koopa_raw_program_t *raw);
 };
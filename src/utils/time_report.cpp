@@ -0,0 +1,88 @@
+#include "utils/time_report.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+bool TimeReport::enabled = false;
+std::vector<TimeReport::Entry> TimeReport::entries;
+std::vector<int> TimeReport::open_stk;
+TimeReport::Clock::time_point TimeReport::start;
+
+static void print_time_report() {
+    TimeReport::Print(std::cerr);
+}
+
+void TimeReport::Enable() {
+    if (enabled)
+        return;
+    enabled = true;
+    start = Clock::now();
+    std::atexit(print_time_report);
+}
+
+//
+// The same phase entered twice under the same parent (e.g. `gen_riscv_func` for every
+// function) is merged into one row, and its call count is increased.
+//
+int TimeReport::Enter(const char *name) {
+    int parent = open_stk.empty() ? -1 : open_stk.back();
+    int idx = -1;
+    for (size_t i = 0; i < entries.size(); ++i)
+        if (entries[i].parent == parent && entries[i].name == name) {
+            idx = i;
+            break;
+        }
+    if (idx < 0) {
+        Entry e;
+        e.name = name;
+        e.parent = parent;
+        e.depth = parent < 0 ? 0 : entries[parent].depth + 1;
+        e.seconds = 0;
+        e.calls = 0;
+        entries.push_back(e);
+        idx = entries.size() - 1;
+    }
+    entries[idx].calls++;
+    open_stk.push_back(idx);
+    return idx;
+}
+
+void TimeReport::Leave(int idx, double seconds) {
+    entries[idx].seconds += seconds;
+    // Guards are scoped, so `idx` is always the innermost phase.
+    open_stk.pop_back();
+}
+
+//
+// Print rows in tree order: every phase is directly followed by its sub-phases.
+// Percentages are relative to the whole run.
+//
+void TimeReport::Print(std::ostream &os) {
+    std::chrono::duration<double> total = Clock::now() - start;
+    double total_sec = total.count() > 0 ? total.count() : 1e-9;
+    char line[256];
+
+    os << "===---------------------------------------------------------===" << std::endl;
+    os << "                    Compiler time report" << std::endl;
+    os << "===---------------------------------------------------------===" << std::endl;
+    snprintf(line, sizeof(line), "  Total wall time: %.3f ms", total.count() * 1000);
+    os << line << std::endl << std::endl;
+    os << "   Wall (ms)      %      Calls  Phase" << std::endl;
+
+    std::vector<int> stk;
+    for (int i = entries.size() - 1; i >= 0; --i)
+        if (entries[i].parent < 0)
+            stk.push_back(i);
+    while (!stk.empty()) {
+        const Entry &e = entries[stk.back()];
+        int cur = stk.back();
+        stk.pop_back();
+        snprintf(line, sizeof(line), "%12.3f  %6.2f%%  %8zu  %*s%s",
+            e.seconds * 1000, e.seconds / total_sec * 100, e.calls,
+            e.depth * 2, "", e.name.c_str());
+        os << line << std::endl;
+        for (int i = entries.size() - 1; i > cur; --i)
+            if (entries[i].parent == cur)
+                stk.push_back(i);
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef TIME_REPORT_H
+#define TIME_REPORT_H
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "utils/mem_report.hpp"
+#include "utils/trace.hpp"
+
+// Wall-clock accounting of the compiler pipeline, enabled by `-time-report`.
+//
+// Phases nest: a phase opened while another one is running is recorded as its child,
+// so the backend sub-steps show up under `riscv` in the final table.
+class TimeReport {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+private:
+    struct Entry {
+        std::string name;
+        int parent;         // index of the enclosing phase, -1 for top level
+        int depth;
+        double seconds;
+        size_t calls;
+    };
+    static std::vector<Entry> entries;
+    static std::vector<int> open_stk;   // phases currently running
+    static Clock::time_point start;
+
+public:
+    static bool enabled;
+
+    // Turn the report on. The table is printed to stderr when the program exits.
+    static void Enable();
+    // Open phase `name` under the innermost running phase, returns its index.
+    static int Enter(const char *name);
+    // Close phase `idx` which has been running for `seconds`.
+    static void Leave(int idx, double seconds);
+    static void Print(std::ostream &os);
+};
+
+// RAII guard of a compiler phase, shared by the time and memory reports and the trace.
+// `detail` (e.g. a function name) only labels the trace event, the reports merge all
+// instances of a phase. Costs a few branches when nothing is enabled.
+class PhaseScope {
+    int idx;
+    int mem_idx;
+    TimeReport::Clock::time_point begin;
+    const char *name;
+    const char *detail;
+    int64_t trace_begin;
+
+public:
+    explicit PhaseScope(const char *_name, const char *_detail = nullptr)
+        : idx(-1), mem_idx(-1), name(_name), detail(_detail), trace_begin(-1) {
+        if (Trace::enabled)
+            trace_begin = Trace::Now();
+        if (MemReport::enabled)
+            mem_idx = MemReport::EnterPhase(_name);
+        if (TimeReport::enabled) {
+            idx = TimeReport::Enter(_name);
+            begin = TimeReport::Clock::now();
+        }
+    }
+    ~PhaseScope() {
+        if (idx >= 0) {
+            std::chrono::duration<double> d = TimeReport::Clock::now() - begin;
+            TimeReport::Leave(idx, d.count());
+        }
+        if (mem_idx >= 0)
+            MemReport::LeavePhase(mem_idx);
+        if (trace_begin >= 0)
+            Trace::Record(name, detail, trace_begin, Trace::Now());
+    }
+    PhaseScope(const PhaseScope &) = delete;
+    PhaseScope &operator=(const PhaseScope &) = delete;
+};
+#endif
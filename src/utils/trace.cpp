@@ -0,0 +1,94 @@
+#include "utils/trace.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+bool Trace::enabled = false;
+std::vector<Trace::Event> Trace::ring;
+size_t Trace::head = 0;
+size_t Trace::dropped = 0;
+std::string Trace::path;
+std::string Trace::process_name;
+
+static void write_trace() {
+    Trace::Write();
+}
+
+void Trace::Enable(const std::string &_path, const std::string &_process_name) {
+    if (enabled)
+        return;
+    enabled = true;
+    path = _path;
+    process_name = _process_name;
+    ring.reserve(capacity);
+    std::atexit(write_trace);
+}
+
+//
+// Append an event. Once the buffer is full the oldest event is overwritten.
+//
+void Trace::Record(const char *name, const char *detail, int64_t begin_ns, int64_t end_ns) {
+    Event e;
+    e.name = name;
+    if (detail)
+        e.detail = detail;
+    e.begin_ns = begin_ns;
+    e.end_ns = end_ns;
+    if (ring.size() < capacity)
+        ring.push_back(e);
+    else {
+        ring[head] = e;
+        head = (head + 1) % capacity;
+        dropped++;
+    }
+}
+
+static void write_json_string(std::ostream &os, const std::string &str) {
+    os << '"';
+    for (char c : str) {
+        if (c == '"' || c == '\\')
+            os << '\\' << c;
+        else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            os << buf;
+        }
+        else
+            os << c;
+    }
+    os << '"';
+}
+
+void Trace::Write() {
+    std::ofstream os(path);
+    if (!os) {
+        std::cerr << "cannot write trace file " << path << std::endl;
+        return;
+    }
+    int pid = getpid();
+    char buf[128];
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+    os << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << pid
+       << ",\"args\":{\"name\":";
+    write_json_string(os, process_name);
+    os << "}}";
+    // Events are stored in order of completion; `head` is the oldest one after a wrap.
+    for (size_t k = 0; k < ring.size(); ++k) {
+        const Event &e = ring[(head + k) % ring.size()];
+        os << "," << std::endl << "{\"name\":";
+        write_json_string(os, e.detail.empty() ? std::string(e.name) : std::string(e.name) + " " + e.detail);
+        snprintf(buf, sizeof(buf), ",\"cat\":\"compiler\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f",
+            e.begin_ns / 1000.0, (e.end_ns - e.begin_ns) / 1000.0);
+        os << buf << ",\"pid\":" << pid << ",\"tid\":" << pid;
+        if (!e.detail.empty()) {
+            os << ",\"args\":{\"detail\":";
+            write_json_string(os, e.detail);
+            os << "}";
+        }
+        os << "}";
+    }
+    os << std::endl << "],\"otherData\":{\"dropped_events\":" << dropped << "}}" << std::endl;
+}
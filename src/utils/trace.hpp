@@ -0,0 +1,57 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Chrome trace (also readable by Perfetto) of the compiler internals, enabled by `-trace`.
+//
+// Complete events are kept in a fixed size ring buffer, so a long compile keeps its latest
+// events, and are written as JSON when the program exits. Timestamps come from the
+// monotonic clock, so traces of compiles running in parallel line up when loaded together.
+class Trace {
+    struct Event {
+        const char *name;
+        std::string detail;
+        int64_t begin_ns;
+        int64_t end_ns;
+    };
+    static const size_t capacity = 1 << 16;
+    static std::vector<Event> ring;
+    static size_t head, dropped;
+    static std::string path, process_name;
+
+public:
+    static bool enabled;
+
+    // Turn tracing on. The JSON is written to `_path` at exit, `_process_name` labels this
+    // compile (usually the input file) on the timeline.
+    static void Enable(const std::string &_path, const std::string &_process_name);
+    static int64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    static void Record(const char *name, const char *detail, int64_t begin_ns, int64_t end_ns);
+    static void Write();
+};
+
+// RAII guard of a trace-only span, for spans which are not compiler phases (the whole
+// compile of a file). Phases get their span from `PhaseScope`.
+class TraceScope {
+    const char *name;
+    const char *detail;
+    int64_t begin;
+
+public:
+    explicit TraceScope(const char *_name, const char *_detail = nullptr)
+        : name(_name), detail(_detail), begin(Trace::enabled ? Trace::Now() : -1) {}
+    ~TraceScope() {
+        if (begin >= 0)
+            Trace::Record(name, detail, begin, Trace::Now());
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+};
+#endif